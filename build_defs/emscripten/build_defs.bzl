@@ -44,6 +44,9 @@ def _cc_wasm_binary(ctx):
     # For generated #includes.
     args.add("-I", ctx.genfiles_dir.path)
 
+    # Extra compiler flags, e.g. "-msimd128" to enable wasm SIMD instructions.
+    args.add_all(ctx.attr.copts)
+
     # Output a wasm file.
     args.add("-o", ctx.outputs.wasm)
 
@@ -75,6 +78,7 @@ cc_wasm_binary = rule(
         "srcs": attr.label_list(allow_files = True),
         "hdrs": attr.label_list(allow_files = True),
         "deps": attr.label_list(providers = [WasmLibInfo]),
+        "copts": attr.string_list(doc = "Additional flags passed to em++."),
         "emsdk_wrapper": attr.label(
             default = Label("//build_defs/emscripten:emsdk_wrapper"),
             executable = True,
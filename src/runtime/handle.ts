@@ -130,6 +130,14 @@ export abstract class HandleOld {
     Entity.createIdentity(entity, Id.fromString(this._id), this.idGenerator);
   }
 
+  /**
+   * Returns a unique prefix that can be followed by a counter to create ids for new entities,
+   * allowing callers such as wasm particles to create ids without a round trip for each one.
+   */
+  newIdPrefix(): string {
+    return this.idGenerator.newChildId(Id.fromString(this._id), 'ids').toString() + ':';
+  }
+
   get type() {
     return this.storage.type;
   }
@@ -287,6 +295,19 @@ export class Collection extends HandleOld {
     await this.storage.remove(serialization.id, keys, this._particleId);
   }
 
+  /**
+   * Removes the entity with the given id from the Handle.
+   * @throws {Error} if this handle is not configured as a writeable handle (i.e. 'out' or 'inout')
+   * in the particle's manifest.
+   */
+  async removeById(id: string) {
+    if (!this.canWrite) {
+      throw new Error('Handle not writeable');
+    }
+    // Remove the keys that exist at storage/proxy.
+    await this.storage.remove(id, [], this._particleId);
+  }
+
   get storage(): Readonly<CollectionStore> {
     return this._storage;
   }
@@ -60,6 +60,14 @@ export abstract class Handle<T extends CRDTTypeRecord> {
     Entity.createIdentity(entity, Id.fromString(this._id), this.idGenerator);
   }
 
+  /**
+   * Returns a unique prefix that can be followed by a counter to create ids for new entities,
+   * allowing callers such as wasm particles to create ids without a round trip for each one.
+   */
+  newIdPrefix(): string {
+    return this.idGenerator.newChildId(Id.fromString(this._id), 'ids').toString() + ':';
+  }
+
   constructor(
       key: string,
       storageProxy: StorageProxy<T>,
@@ -9,7 +9,7 @@
  */
 
 import {assert} from '../../platform/chai-web.js';
-import {EntityPackager} from '../wasm.js';
+import {EntityPackager, RenderScheduler, WasmParticle, WireFormat} from '../wasm.js';
 import {Manifest} from '../manifest.js';
 import {EntityType, ReferenceType} from '../type.js';
 import {Reference} from '../reference.js';
@@ -96,6 +96,38 @@ describe('wasm', () => {
     assert.strictEqual(encoded, '3:53:3:id1|txt:T3:abc|lnk:U10:http://def|num:N9.2:|flg:B1|10:7:id2|two|29:6:!id:3!|txt:T3:def|num:N-7:|');
   });
 
+  it('binary entity packaging round trips all field types', async () => {
+    const {entityClass, handle} = await setup();
+    const packager = new EntityPackager(handle, WireFormat.Binary);
+    for (const data of [{txt: 'abc', lnk: 'http://def', num: 37.5, flg: true},
+                        {txt: '', lnk: '', num: 0, flg: false},
+                        {num: -5.1},
+                        {}]) {
+      const foo = new entityClass(data);
+      Entity.identify(foo, '!test:foo|bar');
+      const encoded = packager.encodeSingleton(foo) as Uint8Array;
+      assert.instanceOf(encoded, Uint8Array);
+      assert.strictEqual(encoded[0], 1);
+      assert.deepEqual(foo, packager.decodeSingleton(encoded));
+    }
+  });
+
+  it('binary entity packaging encodes collections', async () => {
+    const {entityClass, handle} = await setup();
+    const f1 = new entityClass({txt: 'abc', flg: true});
+    Entity.identify(f1, 'id1');
+    const f2 = new entityClass({num: 1});
+    Entity.identify(f2, 'id2');
+
+    const encoded = new EntityPackager(handle, WireFormat.Binary).encodeCollection([f1, f2]);
+    assert.deepEqual([...encoded as Uint8Array], [
+      1, 27, 0, 0, 0,                                     // version, payload length
+      2,                                                  // num entities
+      11, 3, 105, 100, 49, 2, 3, 97, 98, 99, 24, 1,       // "id1", txt (0:Bytes), flg (3:Varint)
+      13, 3, 105, 100, 50, 17, 0, 0, 0, 0, 0, 0, 240, 63  // "id2", num (2:Fixed64)
+    ]);
+  });
+
   it('entity packaging fails for not-yet-supported types', async () => {
     const multifest = await Manifest.parse(`
       schema BytesFail
@@ -123,4 +155,44 @@ describe('wasm', () => {
     verify(multifest.schemas.NamedRefFail, makeRef(new EntityType(multifest.schemas.BytesFail)));
     verify(multifest.schemas.InlineRefFail, makeRef(EntityType.make(['Bar'], {val: 'Text'})));
   });
+
+  it('render scheduler coalesces renders until the next flush', async () => {
+    const rendered = [];
+    const fakeParticle = name => ({flushRender: () => { rendered.push(name); }} as WasmParticle);
+    const [p1, p2] = [fakeParticle('p1'), fakeParticle('p2')];
+
+    const scheduler = new RenderScheduler({policy: 'microtask'});
+    scheduler.schedule(p1);
+    scheduler.schedule(p2);
+    scheduler.schedule(p1);
+    assert.isEmpty(rendered);
+    await Promise.resolve();
+    assert.deepEqual(rendered, ['p1', 'p2']);
+
+    rendered.length = 0;
+    const syncScheduler = new RenderScheduler({policy: 'sync'});
+    syncScheduler.schedule(p1);
+    assert.deepEqual(rendered, ['p1']);
+
+    // Requests from inside the wasm module don't re-enter it, even under the 'sync' policy.
+    rendered.length = 0;
+    syncScheduler.schedule(p2, true);
+    assert.isEmpty(rendered);
+    await Promise.resolve();
+    assert.deepEqual(rendered, ['p2']);
+  });
+
+  it('render scheduler defers particles beyond its budget', async () => {
+    const rendered = [];
+    const fakeParticle = name => ({flushRender: () => { rendered.push(name); }} as WasmParticle);
+
+    // With no budget, each flush renders a single particle.
+    const scheduler = new RenderScheduler({policy: 'microtask', budget: 0});
+    ['p1', 'p2', 'p3'].forEach(name => scheduler.schedule(fakeParticle(name)));
+    await Promise.resolve();
+    assert.deepEqual(rendered, ['p1']);
+    await Promise.resolve();
+    await Promise.resolve();
+    assert.deepEqual(rendered, ['p1', 'p2', 'p3']);
+  });
 });
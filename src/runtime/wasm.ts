@@ -22,6 +22,7 @@ import {Loader} from './loader.js';
 import {PECInnerPort} from './api-channel.js';
 import {UserException} from './arc-exceptions.js';
 import {ParticleExecutionContext} from './particle-execution-context.js';
+import {now} from '../platform/date-web.js';
 
 // Encodes/decodes the wire format for transferring entities over the wasm boundary.
 // Note that entities must have an id before serializing for use in a wasm particle.
@@ -32,6 +33,7 @@ import {ParticleExecutionContext} from './particle-execution-context.js';
 //    URL        <name>:U<length>:<text>
 //    Number     <name>:N<number>:
 //    Boolean    <name>:B<zero-or-one>
+//    Reference  <name>:R<length>:<reference>   (wasm-side only; the host rejects reference fields)
 //
 //  <collection> = <num-entities>:<length>:<encoded><length>:<encoded> ...
 //
@@ -44,11 +46,77 @@ import {ParticleExecutionContext} from './particle-execution-context.js';
 //
 // The encoder classes also support a "Dictionary" format of key:value string pairs:
 //   <size>:<key-len>:<key><value-len>:<value><key-len>:<key><value-len>:<value>...
+//
+// Render models after the first for each slot are sent as a patch to the previous model, with the
+// new and changed entries followed by the keys that were removed:
+//   P<dictionary><num-removed>:<key-len>:<key><key-len>:<key>...
+//
+// C++ particles may instead write render models with typed values, which are always sent whole.
+// Values use the same encoding as entity fields, plus lists of records. Lists with a template name
+// are decoded as {$template, models} for the DOM renderer to stamp out; others become arrays:
+//   <model>  = M<entry><entry>...
+//   <entry>  = <key-len>:<key><value>
+//   <value>  = T<length>:<text> | N<number>: | B<zero-or-one> |
+//              [<template-len>:<template><record><record>...]
+//   <record> = {<entry><entry>...}
+//
+// If the wasm module supports it, entities are instead transferred using a binary format that
+// avoids decimal number conversions and separator scanning. Binary buffers are framed with a
+// version byte (which can never be confused with the leading digit of the text format) and
+// the payload length:
+//
+//  <buffer>     = <version:u8=1><payload-length:u32le><payload>
+//  <singleton>  = <varint:id-length><id><field><field>...
+//  <field>      = <varint:key><value>, where key = (field-index << 3) | wire-type
+//  <value> depends on the wire type:
+//    0: Varint    Boolean as a zero-or-one varint
+//    1: Fixed64   Number as a little-endian float64
+//    2: Bytes     Text and URL as <varint:length><text>, and references as
+//                 <varint:length><reference>
+//
+//  <collection> = <varint:num-entities><varint:length><singleton><varint:length><singleton>...
+//  <reference>  = <varint:id-length><id><varint:key-length><storage-key>
+//
+// Field indices follow the order of the fields in the schema. Unrecognized fields are skipped
+// using the wire type, so adding fields to a schema does not break existing modules.
+//
+// When only some fields of a singleton's current entity have changed, it can instead be updated
+// with a patch holding the entity id and just those fields, in either direction. Cleared fields are
+// marked with a '-' type char in the text format, and by a field key with wire type 3 (which has
+// no value) in the binary format:
+//
+//  <text-patch>    = P<id-length>:<id>|<name>:<value>|<name>:-| ... |
+//  <binary-patch>  = <version:u8=2><payload-length:u32le><varint:id-length><id><field><field>...
+//
+// Collection writes batched by a wasm particle are sent as a sequence of store, remove and clear
+// operations, with entities in either format. Batches are passed with an explicit length rather
+// than being null-terminated:
+//
+//  <batch> = <op><op>...
+//  <op>    = S<length>:<singleton> | R<length>:<id> | C
+
+// Must match the WireFormat enum in src/wasm/cpp/arcs.h.
+export enum WireFormat {Text = 0, Binary = 1}
+
+export type EncodedData = string | Uint8Array;
+
+const BINARY_MARKER = 1;
+const BINARY_HEADER_SIZE = 5;
+const TEXT_PATCH_MARKER = 'P';
+const TYPED_MODEL_MARKER = 'M';
+const BINARY_PATCH_MARKER = 2;
+
+const CHAR_COLON = ':'.charCodeAt(0);
+const CHAR_ZERO = '0'.charCodeAt(0);
+
+enum WireType {Varint = 0, Fixed64 = 1, Bytes = 2, Clear = 3}
+
 export class EntityPackager {
-  private encoder: StringEncoder;
+  private encoder: StringEncoder | BinaryEncoder;
   private decoder: StringDecoder;
+  private binaryDecoder: BinaryDecoder;
 
-  constructor(handle: Handle) {
+  constructor(handle: Handle, readonly format: WireFormat = WireFormat.Text) {
     const schema = handle.entityClass.schema;
     assert(schema.names.length > 0, 'At least one schema name is required for entity packaging');
 
@@ -59,20 +127,43 @@ export class EntityPackager {
       refType = handle.type.getContainedType() as ReferenceType;
     }
 
-    this.encoder = new StringEncoder(schema);
+    if (format === WireFormat.Binary) {
+      this.encoder = new BinaryEncoder(schema);
+    } else {
+      this.encoder = new StringEncoder(schema);
+    }
     this.decoder = new StringDecoder(schema, refType, handle.storage.pec);
+    this.binaryDecoder = new BinaryDecoder(schema, refType, handle.storage.pec);
   }
 
-  encodeSingleton(entity: Entity): string {
+  encodeSingleton(entity: Entity): EncodedData {
     return this.encoder.encodeSingleton(entity);
   }
 
-  encodeCollection(entities: Entity[]): string {
+  encodeCollection(entities: Entity[]): EncodedData {
     return this.encoder.encodeCollection(entities);
   }
 
-  decodeSingleton(str: string): Storable {
-    return this.decoder.decodeSingleton(str);
+  // Encodes the fields that differ between two versions of an entity, for a receiver that already
+  // holds the 'from' version.
+  encodePatch(from: Entity, to: Entity): EncodedData {
+    return this.encoder.encodePatch(from, to);
+  }
+
+  // Accepts data in either wire format.
+  decodeSingleton(data: EncodedData): Storable {
+    if (typeof data === 'string') {
+      return this.decoder.decodeSingleton(data);
+    }
+    return this.binaryDecoder.decodeSingleton(data);
+  }
+
+  // Returns a new entity with the patch (in either wire format) applied to the fields of base.
+  decodePatch(data: EncodedData, base: Entity): Entity {
+    if (typeof data === 'string') {
+      return this.decoder.decodePatch(data, base);
+    }
+    return this.binaryDecoder.decodePatch(data, base);
   }
 }
 
@@ -80,6 +171,22 @@ function encodeStr(str: string) {
   return str.length + ':' + str;
 }
 
+// Calls fn for each schema field whose value differs between from and to, with the new value
+// (undefined for fields that have been cleared).
+function forEachChange(schema: Schema, from: Entity, to: Entity, fn: (field, name: string, value) => void) {
+  for (const [name, field] of Object.entries(schema.fields)) {
+    if (to[name] !== from[name]) {
+      fn(field, name, to[name]);
+    }
+  }
+}
+
+function checkPatchId(id: string, base: Entity) {
+  if (id !== Entity.id(base)) {
+    throw new Error(`Packaged entity decoding fail: patch for '${id}' cannot be applied to '${Entity.id(base)}'`);
+  }
+}
+
 class StringEncoder {
   constructor(readonly schema: Schema) {}
 
@@ -97,6 +204,14 @@ class StringEncoder {
     }
   }
 
+  encodePatch(from: Entity, to: Entity): string {
+    let encoded = TEXT_PATCH_MARKER + encodeStr(Entity.id(to)) + '|';
+    forEachChange(this.schema, from, to, (field, name, value) => {
+      encoded += (value === undefined) ? name + ':-|' : this.encodeField(field, name, value);
+    });
+    return encoded;
+  }
+
   encodeCollection(entities: Entity[]): string {
     let encoded = entities.length + ':';
     for (const entity of entities) {
@@ -171,12 +286,7 @@ class StringDecoder {
       return new Reference({id, storageKey}, this.referenceType, this.pec);
     } else {
       const data = {};
-      while (this.str.length > 0) {
-        const name = this.upTo(':');
-        const typeChar = this.chomp(1);
-        data[name] = this.decodeValue(typeChar);
-        this.validate('|');
-      }
+      this.decodeFields(data);
       const entity = new (this.schema.entityClass())(data);
       if (id !== '') {
         Entity.identify(entity, id);
@@ -185,6 +295,35 @@ class StringDecoder {
     }
   }
 
+  decodePatch(str: string, base: Entity): Entity {
+    this.str = str;
+    this.validate(TEXT_PATCH_MARKER);
+    const len = Number(this.upTo(':'));
+    const id = this.chomp(len);
+    this.validate('|');
+    checkPatchId(id, base);
+
+    const data = Entity.dataClone(base);
+    this.decodeFields(data);
+    const entity = new (this.schema.entityClass())(data);
+    Entity.identify(entity, id);
+    return entity;
+  }
+
+  // Cleared fields only appear in patches.
+  private decodeFields(data: {}) {
+    while (this.str.length > 0) {
+      const name = this.upTo(':');
+      const typeChar = this.chomp(1);
+      if (typeChar === '-') {
+        delete data[name];
+      } else {
+        data[name] = this.decodeValue(typeChar);
+      }
+      this.validate('|');
+    }
+  }
+
   decodeDictionary(str: string): Dictionary<string> {
     this.str = str;
     const dict = {};
@@ -198,6 +337,20 @@ class StringDecoder {
     return dict;
   }
 
+  // Returns a copy of base with a patch in the format above applied to it.
+  decodeDictionaryPatch(str: string, base: Dictionary<ModelValue>): Dictionary<ModelValue> {
+    if (str[0] !== TEXT_PATCH_MARKER) {
+      throw new Error(`Packaged entity decoding fail: expected a dictionary patch in '${str}'`);
+    }
+    const dict = {...base, ...this.decodeDictionary(str.slice(1))};
+    let num = Number(this.upTo(':'));
+    while (num--) {
+      const klen = Number(this.upTo(':'));
+      delete dict[this.chomp(klen)];
+    }
+    return dict;
+  }
+
   private upTo(char) {
     const i = this.str.indexOf(char);
     if (i < 0) {
@@ -243,6 +396,364 @@ class StringDecoder {
   }
 }
 
+// A value in a render model decoded by ModelDecoder.
+export type ModelValue = string | number | boolean | ModelRecord[] | ModelRecord;
+export interface ModelRecord {
+  [key: string]: ModelValue;
+}
+
+// Decodes typed render models. Large models are expected, so the string is scanned in place
+// rather than being sliced for each token.
+class ModelDecoder {
+  private str: string;
+  private pos: number;
+
+  decode(str: string): ModelRecord {
+    this.str = str;
+    this.pos = 0;
+    this.validate(TYPED_MODEL_MARKER);
+    return this.decodeEntries(null);
+  }
+
+  // Decodes entries up to the given terminator, or to the end of the string if it's null.
+  private decodeEntries(terminator: string): ModelRecord {
+    const record: ModelRecord = {};
+    while (terminator ? this.peek() !== terminator : this.pos < this.str.length) {
+      const key = this.decodeText();
+      record[key] = this.decodeValue();
+    }
+    if (terminator) {
+      this.pos++;
+    }
+    return record;
+  }
+
+  private decodeValue(): ModelValue {
+    const typeChar = this.peek();
+    this.pos++;
+    switch (typeChar) {
+      case 'T':
+        return this.decodeText();
+
+      case 'N':
+        return Number(this.upTo(':'));
+
+      case 'B':
+        return this.str[this.pos++] === '1';
+
+      case '[': {
+        const template = this.decodeText();
+        const models: ModelRecord[] = [];
+        while (this.peek() !== ']') {
+          this.validate('{');
+          models.push(this.decodeEntries('}'));
+        }
+        this.pos++;
+        return template ? {$template: template, models} : models;
+      }
+
+      default:
+        throw new Error(`Render model decoding fail: unknown value type '${typeChar}' at position ${this.pos - 1}`);
+    }
+  }
+
+  private decodeText(): string {
+    const len = Number(this.upTo(':'));
+    if (this.pos + len > this.str.length) {
+      throw new Error(`Render model decoding fail: expected '${len}' chars at position ${this.pos}`);
+    }
+    const text = this.str.substr(this.pos, len);
+    this.pos += len;
+    return text;
+  }
+
+  private upTo(char: string): string {
+    const i = this.str.indexOf(char, this.pos);
+    if (i < 0) {
+      throw new Error(`Render model decoding fail: expected '${char}' separator after position ${this.pos}`);
+    }
+    const token = this.str.slice(this.pos, i);
+    this.pos = i + 1;
+    return token;
+  }
+
+  private peek(): string {
+    if (this.pos >= this.str.length) {
+      throw new Error(`Render model decoding fail: unexpected end of model`);
+    }
+    return this.str[this.pos];
+  }
+
+  private validate(char: string) {
+    if (this.peek() !== char) {
+      throw new Error(`Render model decoding fail: expected '${char}' at position ${this.pos}`);
+    }
+    this.pos++;
+  }
+}
+
+class BinaryEncoder {
+  private buf = new Uint8Array(256);
+  private view = new DataView(this.buf.buffer);
+  private pos = 0;
+  private readonly indices: Dictionary<number> = {};
+
+  constructor(readonly schema: Schema) {
+    Object.keys(schema.fields).forEach((name, index) => this.indices[name] = index);
+  }
+
+  encodeSingleton(entity: Entity): Uint8Array {
+    this.pos = BINARY_HEADER_SIZE;
+    this.putEntity(entity);
+    return this.finish();
+  }
+
+  encodePatch(from: Entity, to: Entity): Uint8Array {
+    this.pos = BINARY_HEADER_SIZE;
+    this.putString(Entity.id(to));
+    forEachChange(this.schema, from, to, (field, name, value) => {
+      if (value === undefined) {
+        this.putVarint((this.indices[name] << 3) | WireType.Clear);
+      } else {
+        this.putField(field, this.indices[name], value);
+      }
+    });
+    return this.finish(BINARY_PATCH_MARKER);
+  }
+
+  encodeCollection(entities: Entity[]): Uint8Array {
+    this.pos = BINARY_HEADER_SIZE;
+    this.putVarint(entities.length);
+    for (const entity of entities) {
+      // Write the entity after space for the largest possible length varint, then shift it down
+      // to follow the actual length.
+      const start = this.pos;
+      this.pos += 5;
+      this.putEntity(entity);
+      const len = this.pos - start - 5;
+      this.pos = start;
+      this.putVarint(len);
+      this.buf.copyWithin(this.pos, start + 5, start + 5 + len);
+      this.pos += len;
+    }
+    return this.finish();
+  }
+
+  private putEntity(entity: Entity) {
+    if (entity instanceof Reference) {
+      const {id, storageKey} = entity.dataClone();
+      this.putString(id);
+      this.putString(storageKey);
+    } else {
+      this.putString(Entity.id(entity));
+      for (const [name, value] of Object.entries(entity)) {
+        this.putField(this.schema.fields[name], this.indices[name], value);
+      }
+    }
+  }
+
+  private putField(field, index: number, value) {
+    switch (field.kind) {
+      case 'schema-primitive':
+        break;
+
+      case 'schema-collection':
+      case 'schema-union':
+      case 'schema-tuple':
+      case 'schema-reference':
+        throw new Error(`'${field.kind}' not yet supported for entity packaging`);
+
+      default:
+        throw new Error(`Unknown field kind '${field.kind}' in schema`);
+    }
+
+    switch (field.type) {
+      case 'Text':
+      case 'URL':
+        this.putVarint((index << 3) | WireType.Bytes);
+        this.putString(value);
+        break;
+
+      case 'Number':
+        this.putVarint((index << 3) | WireType.Fixed64);
+        this.ensure(8);
+        this.view.setFloat64(this.pos, value, true);
+        this.pos += 8;
+        break;
+
+      case 'Boolean':
+        this.putVarint((index << 3) | WireType.Varint);
+        this.putVarint(value ? 1 : 0);
+        break;
+
+      case 'Bytes':
+      case 'Object':
+        throw new Error(`'${field.type}' not yet supported for entity packaging`);
+
+      default:
+        throw new Error(`Unknown primitive value type '${field.type}' in schema`);
+    }
+  }
+
+  private putVarint(val: number) {
+    this.ensure(5);
+    while (val >= 0x80) {
+      this.buf[this.pos++] = (val & 0x7f) | 0x80;
+      val >>>= 7;
+    }
+    this.buf[this.pos++] = val;
+  }
+
+  // Currently only supports ASCII, matching WasmContainer.store(). TODO: unicode
+  private putString(str: string) {
+    this.putVarint(str.length);
+    this.ensure(str.length);
+    for (let i = 0; i < str.length; i++) {
+      this.buf[this.pos++] = str.charCodeAt(i);
+    }
+  }
+
+  private ensure(len: number) {
+    if (this.pos + len > this.buf.length) {
+      const buf = new Uint8Array(Math.max(this.buf.length * 2, this.pos + len));
+      buf.set(this.buf.subarray(0, this.pos));
+      this.buf = buf;
+      this.view = new DataView(buf.buffer);
+    }
+  }
+
+  private finish(marker = BINARY_MARKER): Uint8Array {
+    this.buf[0] = marker;
+    this.view.setUint32(1, this.pos - BINARY_HEADER_SIZE, true);
+    return this.buf.slice(0, this.pos);
+  }
+}
+
+class BinaryDecoder {
+  private bytes: Uint8Array;
+  private view: DataView;
+  private pos: number;
+  private end: number;
+  private readonly names: string[];
+
+  constructor(readonly schema: Schema = null,
+              readonly referenceType: ReferenceType = null,
+              readonly pec: ParticleExecutionContext = null) {
+    this.names = schema ? Object.keys(schema.fields) : [];
+  }
+
+  decodeSingleton(bytes: Uint8Array): Storable {
+    this.start(bytes, BINARY_MARKER);
+    const id = this.getString();
+    if (this.referenceType) {
+      const storageKey = this.getString();
+      return new Reference({id, storageKey}, this.referenceType, this.pec);
+    }
+
+    const data = {};
+    this.decodeFields(data);
+    const entity = new (this.schema.entityClass())(data);
+    if (id !== '') {
+      Entity.identify(entity, id);
+    }
+    return entity;
+  }
+
+  decodePatch(bytes: Uint8Array, base: Entity): Entity {
+    this.start(bytes, BINARY_PATCH_MARKER);
+    const id = this.getString();
+    checkPatchId(id, base);
+
+    const data = Entity.dataClone(base);
+    this.decodeFields(data);
+    const entity = new (this.schema.entityClass())(data);
+    Entity.identify(entity, id);
+    return entity;
+  }
+
+  private start(bytes: Uint8Array, marker: number) {
+    this.bytes = bytes;
+    this.view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+    if (bytes.length < BINARY_HEADER_SIZE || bytes[0] !== marker) {
+      throw new Error('Packaged entity decoding fail: invalid binary header');
+    }
+    this.pos = BINARY_HEADER_SIZE;
+    this.end = this.pos + this.view.getUint32(1, true);
+    if (this.end > bytes.length) {
+      throw new Error(`Packaged entity decoding fail: expected ${this.end} bytes; got ${bytes.length}`);
+    }
+  }
+
+  private decodeFields(data: {}) {
+    while (this.pos < this.end) {
+      const key = this.getVarint();
+      const name = this.names[key >>> 3];
+      const value = this.getValue(key & 0x7);
+      // Skip fields that aren't in this schema.
+      if (name === undefined) {
+        continue;
+      }
+      // Cleared fields only appear in patches.
+      if (value === undefined) {
+        delete data[name];
+      } else {
+        data[name] = value;
+      }
+    }
+  }
+
+  private getValue(wireType: number) {
+    switch (wireType) {
+      case WireType.Varint:
+        return this.getVarint() !== 0;
+
+      case WireType.Fixed64: {
+        this.check(8);
+        const num = this.view.getFloat64(this.pos, true);
+        this.pos += 8;
+        return num;
+      }
+
+      case WireType.Bytes:
+        return this.getString();
+
+      case WireType.Clear:
+        return undefined;
+
+      default:
+        throw new Error(`Packaged entity decoding fail: unknown wire type '${wireType}'`);
+    }
+  }
+
+  private getVarint(): number {
+    let val = 0;
+    for (let shift = 0; ; shift += 7) {
+      this.check(1);
+      const byte = this.bytes[this.pos++];
+      val += (byte & 0x7f) * Math.pow(2, shift);
+      if (!(byte & 0x80)) {
+        return val;
+      }
+    }
+  }
+
+  private getString(): string {
+    const len = this.getVarint();
+    this.check(len);
+    let str = '';
+    for (let i = 0; i < len; i++) {
+      str += String.fromCharCode(this.bytes[this.pos++]);
+    }
+    return str;
+  }
+
+  private check(len: number) {
+    if (this.pos + len > this.end) {
+      throw new Error(`Packaged entity decoding fail: expected ${len} bytes to remain`);
+    }
+  }
+}
+
 /**
  * Per-language platform environment and startup specializations for Emscripten and Kotlin.
  */
@@ -444,6 +955,81 @@ class KotlinWasmDriver implements WasmDriver {
 
 type WasmAddress = number;
 
+// When a RenderScheduler renders the particles that have requested it:
+//   'sync'       immediately, as each particle requests a render; requests made from inside the
+//                wasm module are deferred to a microtask (see RenderScheduler.schedule())
+//   'microtask'  once the current task completes
+//   'frame'      before the next animation frame; equivalent to 'microtask' where frames are
+//                not available (e.g. in node)
+export type RenderFlushPolicy = 'sync' | 'microtask' | 'frame';
+
+export interface RenderSchedulerOptions {
+  policy?: RenderFlushPolicy;
+  // The time in ms a flush may spend rendering before the remaining particles are deferred to the
+  // next flush. At least one particle is rendered per flush.
+  budget?: number;
+}
+
+// Coalesces the renders of the particles in a WasmContainer, so that a store update that reaches
+// many particles (or a particle several times) results in one render per particle per flush.
+export class RenderScheduler {
+  readonly policy: RenderFlushPolicy;
+  readonly budget: number;
+  private dirty = new Set<WasmParticle>();
+  private flushRequested = false;
+
+  constructor({policy = 'frame', budget = Infinity}: RenderSchedulerOptions = {}) {
+    this.policy = policy;
+    this.budget = budget;
+  }
+
+  // Marks the particle as needing a render. 'fromWasm' is set for requests made through the
+  // scheduleRender import: rendering those synchronously would re-enter the module while the
+  // particle is still running, so they wait for a microtask even under the 'sync' policy.
+  schedule(particle: WasmParticle, fromWasm = false) {
+    this.dirty.add(particle);
+    if (this.policy === 'sync' && !fromWasm) {
+      this.flush();
+    } else {
+      this.requestFlush();
+    }
+  }
+
+  // Renders the particles that are currently dirty. Particles marked dirty while flushing are left
+  // for the next flush.
+  flush() {
+    const particles = [...this.dirty];
+    this.dirty.clear();
+    const start = now();
+    for (let i = 0; i < particles.length; i++) {
+      particles[i].flushRender();
+      if (i + 1 < particles.length && now() - start >= this.budget) {
+        this.dirty = new Set([...particles.slice(i + 1), ...this.dirty]);
+        break;
+      }
+    }
+    if (this.dirty.size > 0) {
+      this.requestFlush();
+    }
+  }
+
+  private requestFlush() {
+    if (this.flushRequested) {
+      return;
+    }
+    this.flushRequested = true;
+    const run = () => {
+      this.flushRequested = false;
+      this.flush();
+    };
+    if (this.policy === 'frame' && typeof requestAnimationFrame === 'function') {
+      requestAnimationFrame(run);
+    } else {
+      void Promise.resolve().then(run);
+    }
+  }
+}
+
 // Holds an instance of a running wasm module, which may contain multiple particles.
 export class WasmContainer {
   loader: Loader;
@@ -455,10 +1041,13 @@ export class WasmContainer {
   // tslint:disable-next-line: no-any
   exports: any;
   particleMap = new Map<WasmAddress, WasmParticle>();
+  wireFormat = WireFormat.Text;
+  renderScheduler: RenderScheduler;
 
-  constructor(loader: Loader, apiPort: PECInnerPort) {
+  constructor(loader: Loader, apiPort: PECInnerPort, renderOptions: RenderSchedulerOptions = {}) {
     this.loader = loader;
     this.apiPort = apiPort;
+    this.renderScheduler = new RenderScheduler(renderOptions);
   }
 
   async initialize(buffer: ArrayBuffer) {
@@ -475,12 +1064,18 @@ export class WasmContainer {
       // TODO: guard against null/empty args from the wasm side
       _singletonSet: (p, handle, entity) => this.getParticle(p).singletonSet(handle, entity),
       _singletonClear: (p, handle) => this.getParticle(p).singletonClear(handle),
+      _singletonPatch: (p, handle, patch) => this.getParticle(p).singletonPatch(handle, patch),
       _collectionStore: (p, handle, entity) => this.getParticle(p).collectionStore(handle, entity),
       _collectionRemove: (p, handle, entity) => this.getParticle(p).collectionRemove(handle, entity),
+      _collectionRemoveById: (p, handle, id) => this.getParticle(p).collectionRemoveById(handle, id),
       _collectionClear: (p, handle) => this.getParticle(p).collectionClear(handle),
+      _collectionApplyBatch: (p, handle, batch, length) => this.getParticle(p).collectionApplyBatch(handle, batch, length),
+      _leaseIds: (p, handle) => this.getParticle(p).leaseIds(handle),
       _onRenderOutput: (p, template, model) => this.getParticle(p).onRenderOutput(template, model),
       _dereference: (p, handle, refId, continuationId) => this.getParticle(p).dereference(handle, refId, continuationId),
-      _render: (p, slotName, template, model) => this.getParticle(p).renderImpl(slotName, template, model),
+      _scheduleRender: (p) => this.renderScheduler.schedule(this.getParticle(p), true),
+      _registerTemplate: (p, templateId, template, length) => this.getParticle(p).registerTemplate(templateId, template, length),
+      _render: (p, slotName, templateId, model) => this.getParticle(p).renderImpl(slotName, templateId, model),
       _serviceRequest: (p, call, args, tag) => this.getParticle(p).serviceRequest(call, args, tag),
       _resolveUrl: (url) => this.resolve(url),
     };
@@ -492,6 +1087,11 @@ export class WasmContainer {
     this.wasm = await WebAssembly.instantiate(module, {env, global});
     this.exports = this.wasm.exports;
     driver.initializeInstance(this, this.wasm);
+
+    // Modules that don't support negotiation (e.g. Kotlin) use the text format.
+    if (this.exports._negotiateWireFormat) {
+      this.wireFormat = this.exports._negotiateWireFormat(WireFormat.Binary);
+    }
   }
 
   private driverForModule(module: WebAssembly.Module): WasmDriver {
@@ -515,8 +1115,14 @@ export class WasmContainer {
     return this.store(this.loader.resolve(this.read(urlPtr)));
   }
 
-  // Allocates memory in the wasm container.
-  store(str: string): WasmAddress {
+  // Allocates memory in the wasm container. Binary data is self-describing and is not
+  // null-terminated.
+  store(str: EncodedData): WasmAddress {
+    if (typeof str !== 'string') {
+      const bp = this.exports._malloc(str.length);
+      this.heapU8.set(str, bp);
+      return bp;
+    }
     const p = this.exports._malloc(str.length + 1);
     for (let i = 0; i < str.length; i++) {
       this.heapU8[p + i] = str.charCodeAt(i);
@@ -530,6 +1136,34 @@ export class WasmContainer {
     ptrs.forEach(p => p && this.exports._free(p));
   }
 
+  // Reads entity data in either wire format. The returned binary data is a view into the wasm
+  // memory, so it must be used before the memory is freed.
+  readEncoded(idx: WasmAddress): EncodedData {
+    const heap = this.heapU8;
+    if (heap[idx] !== BINARY_MARKER && heap[idx] !== BINARY_PATCH_MARKER) {
+      return this.read(idx);
+    }
+    const len = heap[idx + 1] | (heap[idx + 2] << 8) | (heap[idx + 3] << 16) | (heap[idx + 4] << 24);
+    return heap.subarray(idx, idx + BINARY_HEADER_SIZE + (len >>> 0));
+  }
+
+  // As above, for data with a known length. The data does not need to be null-terminated.
+  readRange(idx: WasmAddress, length: number): EncodedData {
+    if (this.heapU8[idx] === BINARY_MARKER) {
+      return this.heapU8.subarray(idx, idx + length);
+    }
+    return this.readText(idx, length);
+  }
+
+  // Reads a string with a known length. Currently only supports ASCII.
+  readText(idx: WasmAddress, length: number): string {
+    let str = '';
+    for (let i = idx; i < idx + length; i++) {
+      str += String.fromCharCode(this.heapU8[i]);
+    }
+    return str;
+  }
+
   // Currently only supports ASCII. TODO: unicode
   read(idx: WasmAddress): string {
     let str = '';
@@ -550,6 +1184,15 @@ export class WasmParticle extends Particle {
   private handleMap = new Map<Handle, WasmAddress>();
   private revHandleMap = new Map<WasmAddress, Handle>();
   private converters = new Map<Handle, EntityPackager>();
+  // The last render model for each slot (and for onRenderOutput), which later models are patched
+  // against.
+  private renderModels = new Map<string, Dictionary<ModelValue>>();
+  private outputModel: Dictionary<ModelValue> = {};
+  // Templates registered by the wasm particle, keyed by the id it derives from their content.
+  private templates = new Map<string, string>();
+  // The entity held by each entity-typed Singleton as last seen by the wasm particle; used as the
+  // base for patches in both directions.
+  private singletonValues = new Map<Handle, Entity>();
 
   constructor(id: string, container: WasmContainer) {
     super();
@@ -563,11 +1206,16 @@ export class WasmParticle extends Particle {
     }
     this.innerParticle = this.exports[fn]();
     this.container.register(this, this.innerParticle);
-    // TODO(sjmiles): probably too soon: we need to render at least once, but we may have handle
-    // work pending. @shans says: if the particle has readable handles, onHandleUpdate is guaranteed
-    // to be called, otherwise we need `renderOutput` manually. Need to optimize this across all
-    // particle bases.
-    setTimeout(() => this.renderOutput(), 100);
+  }
+
+  // Called by the container's RenderScheduler. C++ particles perform any pending auto-render;
+  // other modules (e.g. Kotlin) render their output.
+  flushRender() {
+    if (this.exports._flushRender) {
+      this.exports._flushRender(this.innerParticle);
+    } else {
+      this.renderOutput();
+    }
   }
 
   renderOutput() {
@@ -585,21 +1233,29 @@ export class WasmParticle extends Particle {
   async setHandles(handles: ReadonlyMap<string, Handle>) {
     for (const [name, handle] of handles) {
       const p = this.container.store(name);
-      const wasmHandle = this.exports._connectHandle(this.innerParticle, p, handle.canRead, handle.canWrite);
-      this.container.free(p);
+      // Writable handles get an initial id prefix so new entities can be identified in wasm.
+      const idPrefix = handle.canWrite ? this.storeIdPrefix(handle) : 0;
+      const wasmHandle = this.exports._connectHandle(this.innerParticle, p, handle.canRead, handle.canWrite, idPrefix);
+      this.container.free(p, idPrefix);
       if (wasmHandle === 0) {
         throw new Error(`Wasm particle failed to connect handle '${name}'`);
       }
       this.handleMap.set(handle, wasmHandle);
       this.revHandleMap.set(wasmHandle, handle);
-      this.converters.set(handle, new EntityPackager(handle));
+      this.converters.set(handle, new EntityPackager(handle, this.container.wireFormat));
     }
     this.exports._init(this.innerParticle);
+    // We need to render at least once, but there may still be handle work pending. @shans says: if
+    // the particle has readable handles, onHandleUpdate is guaranteed to be called, otherwise we
+    // need `renderOutput` manually. Scheduling the render here, after _init, means it always sees
+    // connected handles; the scheduler coalesces it with any render caused by the initial syncs.
+    this.container.renderScheduler.schedule(this);
   }
 
   async onHandleSync(handle: Handle, model) {
     const wasmHandle = this.handleMap.get(handle);
     if (!model) {
+      this.singletonValues.delete(handle);
       this.exports._syncHandle(this.innerParticle, wasmHandle, 0);
       return;
     }
@@ -610,6 +1266,7 @@ export class WasmParticle extends Particle {
     let encoded;
     if (handle instanceof Singleton) {
       encoded = converter.encodeSingleton(model);
+      this.setSingletonValue(handle, model);
     } else {
       encoded = converter.encodeCollection(model);
     }
@@ -632,9 +1289,14 @@ export class WasmParticle extends Particle {
     let p1 = 0;
     let p2 = 0;
     if (handle instanceof Singleton) {
-      if (update.data) {
+      // Changes to the entity the particle already has are sent as a patch.
+      const base = this.singletonValues.get(handle);
+      if (base && update.data instanceof Entity && Entity.id(update.data) === Entity.id(base)) {
+        p1 = this.container.store(converter.encodePatch(base, update.data));
+      } else if (update.data) {
         p1 = this.container.store(converter.encodeSingleton(update.data));
       }
+      this.setSingletonValue(handle, update.data);
     } else {
       p1 = this.container.store(converter.encodeCollection(update.added || []));
       p2 = this.container.store(converter.encodeCollection(update.removed || []));
@@ -661,15 +1323,30 @@ export class WasmParticle extends Particle {
     const singleton = this.getHandle(wasmHandle) as Singleton;
     const entity = this.decodeEntity(singleton, entityPtr);
     const p = this.ensureIdentified(entity, singleton);
+    this.setSingletonValue(singleton, entity);
     void singleton.set(entity);
     return p;
   }
 
   singletonClear(wasmHandle: WasmAddress) {
     const singleton = this.getHandle(wasmHandle) as Singleton;
+    this.singletonValues.delete(singleton);
     void singleton.clear();
   }
 
+  // The storage API only sets whole entities, so the patch is applied to the particle's current
+  // value to rebuild the full entity; this saves encoding and copying the unchanged fields.
+  singletonPatch(wasmHandle: WasmAddress, patchPtr: WasmAddress) {
+    const singleton = this.getHandle(wasmHandle) as Singleton;
+    const base = this.singletonValues.get(singleton);
+    if (!base) {
+      throw new Error(`wasm particle '${this.spec.name}' sent a patch for singleton '${singleton.name}' with no value`);
+    }
+    const entity = this.converters.get(singleton).decodePatch(this.container.readEncoded(patchPtr), base);
+    this.singletonValues.set(singleton, entity);
+    void singleton.set(entity);
+  }
+
   // If the given entity doesn't have an id, this will create one for it and return the new id
   // in allocated memory that the wasm particle must free. If the entity already has an id this
   // returns 0 (nulltpr).
@@ -686,11 +1363,64 @@ export class WasmParticle extends Particle {
     void collection.remove(this.decodeEntity(collection, entityPtr));
   }
 
+  collectionRemoveById(wasmHandle: WasmAddress, idPtr: WasmAddress) {
+    const collection = this.getHandle(wasmHandle) as Collection;
+    void collection.removeById(this.container.read(idPtr));
+  }
+
   collectionClear(wasmHandle: WasmAddress) {
     const collection = this.getHandle(wasmHandle) as Collection;
     void collection.clear();
   }
 
+  // Applies a batch of writes deferred by a WriteBatch in the wasm particle. The storage API has
+  // no multi-op write, so the batch is decoded up front (the wasm buffer is freed on return) and
+  // each operation waits for the previous one, keeping e.g. a clear ahead of the stores after it.
+  // The batch saves the per-write boundary crossings.
+  collectionApplyBatch(wasmHandle: WasmAddress, batchPtr: WasmAddress, length: number) {
+    const collection = this.getHandle(wasmHandle) as Collection;
+    const heap = this.container.heapU8;
+    const end = batchPtr + length;
+    const ops: (() => Promise<unknown>)[] = [];
+    let idx = batchPtr;
+    while (idx < end) {
+      const op = String.fromCharCode(heap[idx++]);
+      if (op === 'C') {
+        ops.push(() => collection.clear());
+        continue;
+      }
+      let size = 0;
+      while (heap[idx] !== CHAR_COLON) {
+        size = size * 10 + heap[idx++] - CHAR_ZERO;
+      }
+      idx++;
+      if (op === 'S') {
+        const converter = this.converters.get(collection);
+        const entity = converter.decodeSingleton(this.container.readRange(idx, size));
+        this.identify(entity, collection);
+        ops.push(() => collection.store(entity));
+      } else if (op === 'R') {
+        const id = this.container.readText(idx, size);
+        ops.push(() => collection.removeById(id));
+      } else {
+        throw new Error(`wasm particle '${this.spec.name}' sent an invalid write batch`);
+      }
+      idx += size;
+    }
+    void ops.reduce((prev, op) => prev.then(op), Promise.resolve<unknown>(undefined));
+  }
+
+  // Called when a handle has used up its id prefix. Allocates memory that the wasm particle must
+  // free.
+  leaseIds(wasmHandle: WasmAddress): WasmAddress {
+    return this.storeIdPrefix(this.getHandle(wasmHandle));
+  }
+
+  // Stores a new id prefix for the handle in wasm memory.
+  private storeIdPrefix(handle: Handle): WasmAddress {
+    return this.container.store(handle.newIdPrefix());
+  }
+
   // Called by particles to retrieve the entity held by a reference-typed handle.
   async dereference(wasmHandle: WasmAddress, refIdPtr: WasmAddress, continuationId: number) {
     const handle = this.getHandle(wasmHandle);
@@ -728,19 +1458,32 @@ export class WasmParticle extends Particle {
     return handle;
   }
 
+  private setSingletonValue(handle: Handle, value: Storable) {
+    if (value instanceof Entity) {
+      this.singletonValues.set(handle, value);
+    } else {
+      this.singletonValues.delete(handle);
+    }
+  }
+
   private decodeEntity(handle: Handle, entityPtr: WasmAddress): Storable {
     const converter = this.converters.get(handle);
-    return converter.decodeSingleton(this.container.read(entityPtr));
+    return converter.decodeSingleton(this.container.readEncoded(entityPtr));
   }
 
   private ensureIdentified(entity: Storable, handle: Handle): WasmAddress {
-    let p = 0;
+    return this.identify(entity, handle) ? this.container.store(Entity.id(entity)) : 0;
+  }
+
+  // Creates an id for an entity the wasm particle sent without one (if its id lease failed).
+  // Returns false if the entity already had an id.
+  private identify(entity: Storable, handle: Handle): boolean {
     // TODO: rework Reference/Entity internals to avoid this instance check?
     if (entity instanceof Entity && !Entity.isIdentified(entity)) {
       handle.createIdentityFor(entity);
-      p = this.container.store(Entity.id(entity));
+      return true;
     }
-    return p;
+    return false;
   }
 
   // TODO(sjmiles): UiBroker changes ... we don't have `capabilities` yet,
@@ -753,7 +1496,8 @@ export class WasmParticle extends Particle {
   onRenderOutput(templatePtr: WasmAddress, modelPtr: WasmAddress) {
     const content: Content = {templateName: 'default'};
     content.template = this.container.read(templatePtr);
-    content.model = new StringDecoder().decodeDictionary(this.container.read(modelPtr));
+    this.outputModel = this.decodeModel(modelPtr, this.outputModel);
+    content.model = this.outputModel;
     this.output(content);
   }
 
@@ -777,28 +1521,60 @@ export class WasmParticle extends Particle {
     throw new Error('renderHostedSlot not implemented for wasm particles');
   }
 
+  // Called by the wasm particle the first time it renders a given template.
+  registerTemplate(templateIdPtr: WasmAddress, templatePtr: WasmAddress, length: number) {
+    this.templates.set(this.container.read(templateIdPtr), this.container.readText(templatePtr, length));
+  }
+
   /**
    * @deprecated for contexts using UiBroker (e.g Kotlin)
    */
   // Actually renders the slot. May be invoked due to an external request via renderSlot(),
   // or directly from the wasm particle itself (e.g. in response to a data update).
-  // template is a string provided by the particle. model is an encoded Dictionary.
-  renderImpl(slotNamePtr: WasmAddress, templatePtr: WasmAddress, modelPtr: WasmAddress) {
-    const slot = this.slotProxiesByName.get(this.container.read(slotNamePtr));
+  // templateId refers to a template passed to registerTemplate(). model is an encoded Dictionary.
+  renderImpl(slotNamePtr: WasmAddress, templateIdPtr: WasmAddress, modelPtr: WasmAddress) {
+    const slotName = this.container.read(slotNamePtr);
+    // The model is tracked even if the slot isn't available, since the particle's next model for
+    // it may be a patch.
+    let model: Dictionary<ModelValue> = null;
+    if (modelPtr) {
+      model = this.decodeModel(modelPtr, this.renderModels.get(slotName));
+      this.renderModels.set(slotName, model);
+    }
+    const slot = this.slotProxiesByName.get(slotName);
     if (slot) {
       const content: Content = {templateName: 'default'};
-      if (templatePtr) {
-        content.template = this.container.read(templatePtr);
+      if (templateIdPtr) {
+        const templateId = this.container.read(templateIdPtr);
+        content.template = this.templates.get(templateId);
+        if (content.template === undefined) {
+          throw new Error(`wasm particle '${this.spec.name}' rendered unregistered template '${templateId}'`);
+        }
         slot.requestedContentTypes.add('template');
       }
-      if (modelPtr) {
-        content.model = new StringDecoder().decodeDictionary(this.container.read(modelPtr));
+      if (model) {
+        content.model = model;
         slot.requestedContentTypes.add('model');
       }
       slot.render(content);
     }
   }
 
+  // Decodes a full or typed render model, or applies a patch to the previous one.
+  private decodeModel(modelPtr: WasmAddress, previous: Dictionary<ModelValue>): Dictionary<ModelValue> {
+    const str = this.container.read(modelPtr);
+    if (str[0] === TYPED_MODEL_MARKER) {
+      return new ModelDecoder().decode(str);
+    }
+    if (str[0] === TEXT_PATCH_MARKER) {
+      if (!previous) {
+        throw new Error(`wasm particle '${this.spec.name}' sent a model patch with no previous model`);
+      }
+      return new StringDecoder().decodeDictionaryPatch(str, previous);
+    }
+    return new StringDecoder().decodeDictionary(str);
+  }
+
   // Wasm particles can request service calls with a Dictionary of arguments and an optional string
   // tag to disambiguate different requests to the same service call.
   async serviceRequest(callPtr: WasmAddress, argsPtr: WasmAddress, tagPtr: WasmAddress) {
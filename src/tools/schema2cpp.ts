@@ -26,12 +26,15 @@ const keywords = [
   'xor', 'xor_eq'
 ];
 
+// 'align' groups the member declarations so that the generated classes have no padding holes:
+// 8 = double, 4 = pointer-aligned (wasm32) types, 1 = bool.
+// 'columnar' fields are included in the generated Columns<T> view.
 const typeMap = {
-  'T': {type: () => 'std::string',    returnByRef: true,  setByRef: true,  useCompare: true},
-  'U': {type: () => 'URL',            returnByRef: true,  setByRef: true,  useCompare: true},
-  'N': {type: () => 'double',         returnByRef: false, setByRef: false, useCompare: false},
-  'B': {type: () => 'bool',           returnByRef: false, setByRef: false, useCompare: false},
-  'R': {type: name => `Ref<${name}>`, returnByRef: false, setByRef: true,  useCompare: false},
+  'T': {type: () => 'std::string',    returnByRef: true,  setByRef: true,  useCompare: true,  isString: true,  align: 4, columnar: false},
+  'U': {type: () => 'URL',            returnByRef: true,  setByRef: true,  useCompare: true,  isString: true,  align: 4, columnar: false},
+  'N': {type: () => 'double',         returnByRef: false, setByRef: false, useCompare: false, isString: false, align: 8, columnar: true},
+  'B': {type: () => 'bool',           returnByRef: false, setByRef: false, useCompare: false, isString: false, align: 1, columnar: true},
+  'R': {type: name => `Ref<${name}>`, returnByRef: false, setByRef: true,  useCompare: false, isString: false, align: 4, columnar: false},
 };
 
 export class Schema2Cpp extends Schema2Base {
@@ -55,70 +58,151 @@ export class Schema2Cpp extends Schema2Base {
   }
 
   entityClass(name: string, schema: Schema): string {
-    const fields: string[] = [];
+    const fields: {align: number, decl: string}[] = [];
     const api: string[] = [];
     const clone: string[] = [];
+    const reset: string[] = [];
     const hash: string[] = [];
     const equals: string[] = [];
     const less: string[] = [];
     const decode: string[] = [];
+    const decodeBinary: string[] = [];
     const encode: string[] = [];
+    const encodeBinary: string[] = [];
+    const encodedSize: string[] = [];
+    const encodedSizeBinary: string[] = [];
+    const diff: string[] = [];
+    const diffBinary: string[] = [];
+    const patch: string[] = [];
+    const patchBinary: string[] = [];
     const toString: string[] = [];
-
+    const fieldNames: string[] = [];
+    const columnApi: string[] = [];
+    const columnFields: string[] = [];
+    const columnResize: string[] = [];
+    const columnAssign: string[] = [];
+    const columnRemove: string[] = [];
+
+    // Field ids for both wire formats are the field indices in schema order.
+    let fieldIndex = 0;
     const fieldCount = this.processSchema(schema, (field: string, typeChar: string, refName: string) => {
       const typeInfo = typeMap[typeChar];
       const type = typeInfo.type(refName);
       const [r1, r2] = typeInfo.returnByRef ? ['const ', '&'] : ['', ''];
       const [s1, s2] = typeInfo.setByRef ? ['const ', '&'] : ['', ''];
       const fixed = (keywords.includes(field) ? '_' : '') + field;
-      const valid = `${field}_valid_`;
+      // Validity is tracked by bit <fieldIndex> of the _valid_ mask.
+      const valid = (obj: string) => `${obj}_valid_.test(${fieldIndex})`;
+      const [setValid, clearValid] = ['set', 'reset'].map(op => `_valid_.${op}(${fieldIndex});`);
 
-      fields.push(`${type} ${field}_ = ${type}();`,
-                  `bool ${valid} = false;`,
-                  ``);
+      fields.push({align: typeInfo.align, decl: `${type} ${field}_ = ${type}();`});
 
       api.push(`${r1}${type}${r2} ${fixed}() const { return ${field}_; }`,
-               `void set_${field}(${s1}${type}${s2} value) { ${field}_ = value; ${valid} = true; }`,
-               `void clear_${field}() { ${field}_ = ${type}(); ${valid} = false; }`,
-               `bool has_${field}() const { return ${valid}; }`,
+               `void set_${field}(${s1}${type}${s2} value) { ${field}_ = value; ${setValid} }`,
+               `void clear_${field}() { ${field}_ = ${type}(); ${clearValid} }`,
+               `bool has_${field}() const { return ${valid('')}; }`,
                ``);
 
-      clone.push(`clone.${field}_ = entity.${field}_;`,
-                 `clone.${valid} = entity.${valid};`);
+      clone.push(`clone.${field}_ = entity.${field}_;`);
+
+      // Strings are cleared rather than replaced so their buffers can be reused.
+      reset.push(typeInfo.isString ? `entity->${field}_.clear();` : `entity->${field}_ = ${type}();`);
 
-      hash.push(`if (entity.${valid})`,
+      hash.push(`if (${valid('entity.')})`,
                 `  internal::hash_combine(h, entity.${field}_);`);
 
-      equals.push(`(a.${valid} ? (b.${valid} && a.${field}_ == b.${field}_) : !b.${valid})`);
+      // The masks have already been compared, so only a's bits need checking.
+      equals.push(`(!${valid('a.')} || a.${field}_ == b.${field}_)`);
 
-      less.push(`if (a.${valid} != b.${valid}) {`,
-                `  return !a.${valid};`);
+      less.push(`if (${valid('a.')} != ${valid('b.')}) {`,
+                `  return !${valid('a.')};`);
       if (typeInfo.useCompare) {
-        less.push(`} else {`,
+        less.push(`} else if (${valid('a.')}) {`,
                   `  cmp = a.${field}_.compare(b.${field}_);`,
                   `  if (cmp != 0) return cmp < 0;`,
                   `}`);
       } else {
-        less.push(`} else if (a.${field}_ != b.${field}_) {`,
+        less.push(`} else if (${valid('a.')} && a.${field}_ != b.${field}_) {`,
                   `  return a.${field}_ < b.${field}_;`,
                   `}`);
       }
 
-      decode.push(`} else if (name == "${field}") {`,
+      decode.push(`case ${fieldIndex}:`,
                   `  decoder.validate("${typeChar}");`,
                   `  decoder.decode(entity->${field}_);`,
-                  `  entity->${valid} = true;`);
+                  `  entity->${setValid}`,
+                  `  break;`);
+
+      fieldNames.push(field);
 
-      encode.push(`if (entity.${valid})`,
+      decodeBinary.push(`case ${fieldIndex}:`,
+                        `  decoder.decode(entity->${field}_);`,
+                        `  entity->${setValid}`,
+                        `  break;`);
+
+      encode.push(`if (${valid('entity.')})`,
                   `  encoder.encode("${field}:${typeChar}", entity.${field}_);`);
 
-      toString.push(`if (entity.${valid})`,
+      encodeBinary.push(`if (${valid('entity.')})`,
+                        `  encoder.encode(${fieldIndex}, entity.${field}_);`);
+
+      encodedSize.push(`if (${valid('entity.')})`,
+                       `  size += encoder.size("${field}:${typeChar}", entity.${field}_);`);
+
+      encodedSizeBinary.push(`if (${valid('entity.')})`,
+                             `  size += encoder.size(${fieldIndex}, entity.${field}_);`);
+
+      // Patches hold the fields that were changed or set, and mark those that were cleared.
+      const changed = `!${valid('from.')} || from.${field}_ != to.${field}_`;
+      diff.push(`if (${valid('to.')}) {`,
+                `  if (${changed}) encoder.encode("${field}:${typeChar}", to.${field}_);`,
+                `} else if (${valid('from.')}) {`,
+                `  encoder.encodeClear("${field}:");`,
+                `}`);
+
+      diffBinary.push(`if (${valid('to.')}) {`,
+                      `  if (${changed}) encoder.encode(${fieldIndex}, to.${field}_);`,
+                      `} else if (${valid('from.')}) {`,
+                      `  encoder.encodeClear(${fieldIndex});`,
+                      `}`);
+
+      patch.push(`case ${fieldIndex}:`,
+                 `  if (decoder.cleared()) {`,
+                 `    entity->clear_${field}();`,
+                 `  } else {`,
+                 `    decoder.validate("${typeChar}");`,
+                 `    decoder.decode(entity->${field}_);`,
+                 `    entity->${setValid}`,
+                 `  }`,
+                 `  break;`);
+
+      patchBinary.push(`case ${fieldIndex}:`,
+                       `  if (decoder.cleared()) {`,
+                       `    entity->clear_${field}();`,
+                       `  } else {`,
+                       `    decoder.decode(entity->${field}_);`,
+                       `    entity->${setValid}`,
+                       `  }`,
+                       `  break;`);
+
+      toString.push(`if (${valid('entity.')})`,
                     `  printer.add("${field}: ", entity.${field}_);`);
+
+      if (typeInfo.columnar) {
+        columnApi.push(`const Column<${type}>& ${fixed}() const { return ${field}_; }`);
+        columnFields.push(`Column<${type}> ${field}_;`);
+        columnResize.push(`${field}_.resize(size);`);
+        columnAssign.push(`${field}_.assign(row, entity.${field}_, ${valid('entity.')});`);
+        columnRemove.push(`${field}_.swap_remove(row);`);
+      }
+
+      fieldIndex++;
     });
 
-    if (fieldCount === 0) {
-      equals.push('true');
-    }
+    // Stable sort, so fields with the same alignment stay in schema order.
+    const members = fields.sort((a, b) => b.align - a.align);
+    const wideMembers = members.filter(m => m.align > 1).map(m => m.decl);
+    const byteMembers = members.filter(m => m.align === 1).map(m => m.decl);
 
     return `\
 
@@ -154,22 +238,65 @@ private:
   ${name}(const ${name}&) = default;
   ${name}& operator=(const ${name}&) = default;
 
-  ${fields.join('\n  ')}
-  std::string _internal_id_;
+  // Members are ordered by alignment to avoid padding; bit i of _valid_ is set if field i (in
+  // schema order) has a value.
+  ${[...wideMembers, 'internal::Id _internal_id_;', ...byteMembers].join('\n  ')}
+  internal::FieldMask<${fieldCount}> _valid_;
   static const int _FIELD_COUNT = ${fieldCount};
 
+  // Maps text-format field names to field indices; returns -1 for unknown fields.
+  static constexpr int _field_index(std::string_view name) {
+    ${this.fieldIndexDispatch(fieldNames).join('\n    ')}
+  }
+
   friend class Singleton<${name}>;
   friend class Collection<${name}>;
+  friend class Columns<${name}>;
   friend class internal::Accessor;
 };
 
+template<>
+class Columns<${name}> {
+public:
+  size_t size() const { return size_; }
+  ${columnApi.join('\n  ')}
+
+private:
+  void resize(size_t size) {
+    size_ = size;
+    ${columnResize.join('\n    ')}
+  }
+
+  void assign(size_t row, const ${name}& entity) {
+    ${columnAssign.join('\n    ')}
+  }
+
+  void swap_remove(size_t row) {
+    size_--;
+    ${columnRemove.join('\n    ')}
+  }
+
+  size_t size_ = 0;
+  ${columnFields.join('\n  ')}
+
+  friend class Collection<${name}>;
+};
+
 template<>
 inline ${name} internal::Accessor::clone_entity(const ${name}& entity) {
   ${name} clone;
   ${clone.join('\n  ')}
+  clone._valid_ = entity._valid_;
   return clone;
 }
 
+template<>
+inline void internal::Accessor::reset_entity(${name}* entity) {
+  entity->_internal_id_ = internal::Id();
+  ${reset.join('\n  ')}
+  entity->_valid_.clear();
+}
+
 template<>
 inline size_t internal::Accessor::hash_entity(const ${name}& entity) {
   size_t h = 0;
@@ -180,7 +307,7 @@ inline size_t internal::Accessor::hash_entity(const ${name}& entity) {
 
 template<>
 inline bool internal::Accessor::fields_equal(const ${name}& a, const ${name}& b) {
-  return ${equals.join(' && \n         ')};
+  return ${['a._valid_ == b._valid_', ...equals].join(' && \n         ')};
 }
 
 inline bool ${name}::operator==(const ${name}& other) const {
@@ -196,26 +323,88 @@ inline std::string internal::Accessor::entity_to_str(const ${name}& entity, cons
 }
 
 template<>
-inline void internal::Accessor::decode_entity(${name}* entity, const char* str) {
-  if (str == nullptr) return;
-  internal::StringDecoder decoder(str);
+inline void internal::Accessor::decode_entity(${name}* entity, internal::StringDecoder& decoder) {
   decoder.decode(entity->_internal_id_);
   decoder.validate("|");
-  for (int i = 0; !decoder.done() && i < ${name}::_FIELD_COUNT; i++) {
-    std::string name = decoder.upTo(':');
-    if (0) {
-    ${decode.join('\n    ')}
+  while (!decoder.done()) {
+    switch (${name}::_field_index(decoder.upTo(':'))) {
+      ${decode.join('\n      ')}
+      default:
+        decoder.skip();
     }
     decoder.validate("|");
   }
 }
 
 template<>
-inline std::string internal::Accessor::encode_entity(const ${name}& entity) {
-  internal::StringEncoder encoder;
+inline void internal::Accessor::decode_entity(${name}* entity, internal::BinaryDecoder& decoder) {
+  decoder.decode(entity->_internal_id_);
+  while (!decoder.done()) {
+    switch (decoder.field()) {
+      ${decodeBinary.join('\n      ')}
+      default:
+        decoder.skip();
+    }
+  }
+}
+
+template<>
+inline void internal::Accessor::encode_entity(const ${name}& entity, internal::StringEncoder& encoder) {
   encoder.encode("", entity._internal_id_);
   ${encode.join('\n  ')}
-  return encoder.result();
+}
+
+template<>
+inline void internal::Accessor::encode_entity(const ${name}& entity, internal::BinaryEncoder& encoder) {
+  encoder.encodeString(entity._internal_id_);
+  ${encodeBinary.join('\n  ')}
+}
+
+template<>
+inline size_t internal::Accessor::encoded_size(const ${name}& entity, const internal::StringEncoder& encoder) {
+  size_t size = encoder.size("", entity._internal_id_);
+  ${encodedSize.join('\n  ')}
+  return size;
+}
+
+template<>
+inline size_t internal::Accessor::encoded_size(const ${name}& entity, const internal::BinaryEncoder& encoder) {
+  size_t size = encoder.stringSize(entity._internal_id_);
+  ${encodedSizeBinary.join('\n  ')}
+  return size;
+}
+
+template<>
+inline void internal::Accessor::diff_entity(const ${name}& from, const ${name}& to, internal::StringEncoder& encoder) {
+  ${diff.join('\n  ')}
+}
+
+template<>
+inline void internal::Accessor::diff_entity(const ${name}& from, const ${name}& to, internal::BinaryEncoder& encoder) {
+  ${diffBinary.join('\n  ')}
+}
+
+template<>
+inline void internal::Accessor::apply_patch(${name}* entity, internal::StringDecoder& decoder) {
+  while (!decoder.done()) {
+    switch (${name}::_field_index(decoder.upTo(':'))) {
+      ${patch.join('\n      ')}
+      default:
+        decoder.skip();
+    }
+    decoder.validate("|");
+  }
+}
+
+template<>
+inline void internal::Accessor::apply_patch(${name}* entity, internal::BinaryDecoder& decoder) {
+  while (!decoder.done()) {
+    switch (decoder.field()) {
+      ${patchBinary.join('\n      ')}
+      default:
+        decoder.skip();
+    }
+  }
 }
 
 }  // namespace arcs
@@ -229,4 +418,34 @@ struct std::hash<arcs::${name}> {
 };
 `;
   }
+
+  // Generates a switch on name length then first character, so decoding a field name costs at
+  // most one string comparison (more only when names share both their length and first char).
+  private fieldIndexDispatch(names: string[]): string[] {
+    const groups = new Map<number, Map<string, number[]>>();
+    names.forEach((name, index) => {
+      if (!groups.has(name.length)) {
+        groups.set(name.length, new Map());
+      }
+      const byChar = groups.get(name.length);
+      byChar.set(name[0], [...(byChar.get(name[0]) || []), index]);
+    });
+    if (groups.size === 0) {
+      return ['return -1;'];
+    }
+
+    const lines = ['switch (name.size()) {'];
+    for (const len of [...groups.keys()].sort((a, b) => a - b)) {
+      lines.push(`  case ${len}:`,
+                 `    switch (name[0]) {`);
+      for (const [ch, indices] of [...groups.get(len).entries()].sort()) {
+        const tests = indices.map(i => `name == "${names[i]}" ? ${i} : `).join('');
+        lines.push(`      case '${ch}': return ${tests}-1;`);
+      }
+      lines.push(`    }`,
+                 `    break;`);
+    }
+    lines.push('}', 'return -1;');
+    return lines;
+  }
 }
@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <deque>
 
 #include "src/wasm/cpp/arcs.h"
 
@@ -10,11 +14,16 @@ extern "C" {
 
 EM_JS(const char*, singletonSet, (Particle* p, Handle* h, const char* encoded), {})
 EM_JS(void, singletonClear, (Particle* p, Handle* h), {})
+EM_JS(void, singletonPatch, (Particle* p, Handle* h, const char* encoded), {})
 EM_JS(const char*, collectionStore, (Particle* p, Handle* h, const char* encoded), {})
-EM_JS(void, collectionRemove, (Particle* p, Handle* h, const char* encoded), {})
+EM_JS(void, collectionRemoveById, (Particle* p, Handle* h, const char* id), {})
 EM_JS(void, collectionClear, (Particle* p, Handle* h), {})
+EM_JS(void, collectionApplyBatch, (Particle* p, Handle* h, const char* encoded, size_t length), {})
+EM_JS(const char*, leaseIds, (Particle* p, Handle* h), {})
 EM_JS(void, dereference, (Particle* p, Handle* h, const char* ref_id, size_t continuation_id), {})
-EM_JS(void, render, (Particle* p, const char* slotName, const char* template_str, const char* model), {})
+EM_JS(void, registerTemplate, (Particle* p, const char* template_id, const char* template_str, size_t length), {})
+EM_JS(void, scheduleRender, (Particle* p), {})
+EM_JS(void, render, (Particle* p, const char* slotName, const char* template_id, const char* model), {})
 EM_JS(void, serviceRequest, (Particle* p, const char* call, const char* args, const char* tag), {})
 EM_JS(const char*, resolveUrl, (const char* url), {})
 EM_JS(void, setLogInfo, (const char* file, int line), {})
@@ -22,9 +31,20 @@ EM_JS(void, systemError, (const char* msg), {})
 
 // --- JS-to-wasm API ---
 
+static WireFormat wire_format = WireFormat::Text;
+
+// Called by the runtime at startup with the highest wire format version it supports; returns
+// the version that will be used for entity data sent from this module.
+EMSCRIPTEN_KEEPALIVE
+int negotiateWireFormat(int host_version) {
+  wire_format = (host_version >= int(WireFormat::Binary)) ? WireFormat::Binary : WireFormat::Text;
+  return int(wire_format);
+}
+
 EMSCRIPTEN_KEEPALIVE
-Handle* connectHandle(Particle* particle, const char* name, bool can_read, bool can_write) {
-  return particle->connectHandle(name, can_read, can_write);
+Handle* connectHandle(Particle* particle, const char* name, bool can_read, bool can_write,
+                      const char* id_prefix) {
+  return particle->connectHandle(name, can_read, can_write, id_prefix);
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -51,7 +71,12 @@ void dereferenceResponse(Particle* particle, size_t continuation_id, const char*
 
 EMSCRIPTEN_KEEPALIVE
 void renderSlot(Particle* particle, const char* slot_name, bool send_template, bool send_model) {
-  particle->renderSlot(slot_name, send_template, send_model);
+  particle->requestRender(slot_name, send_template, send_model);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void flushRender(Particle* particle) {
+  particle->flushRender();
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -138,96 +163,312 @@ EMSCRIPTEN_KEEPALIVE int __syscall54(int, int) { return 0; }   // sys_ioctl
 
 // --- Packaging classes ---
 
+WireFormat wireFormat() {
+  return wire_format;
+}
+
+// Id
+namespace {
+
+struct InternEntry {
+  std::string str;
+  uint32_t refs;
+};
+
+// Entries are kept in a deque so the lookup keys (views of the entry strings) stay valid as the
+// table grows.
+struct InternTable {
+  std::deque<InternEntry> entries = {{"", 0}};
+  std::vector<uint32_t> free;
+  std::unordered_map<std::string_view, uint32_t> lookup;
+};
+
+InternTable& intern_table() {
+  static InternTable table;
+  return table;
+}
+
+}  // namespace
+
+const std::string& Id::str() const {
+  return intern_table().entries[handle_].str;
+}
+
+uint32_t Id::intern(std::string_view str) {
+  if (str.empty()) {
+    return 0;
+  }
+  InternTable& table = intern_table();
+  auto it = table.lookup.find(str);
+  if (it != table.lookup.end()) {
+    table.entries[it->second].refs++;
+    return it->second;
+  }
+  uint32_t handle;
+  if (table.free.empty()) {
+    handle = table.entries.size();
+    table.entries.push_back({std::string(str), 1});
+  } else {
+    handle = table.free.back();
+    table.free.pop_back();
+    table.entries[handle].str.assign(str);
+    table.entries[handle].refs = 1;
+  }
+  table.lookup.emplace(table.entries[handle].str, handle);
+  return handle;
+}
+
+bool Id::lookup(std::string_view str, Id* id) {
+  if (str.empty()) {
+    *id = Id();
+    return true;
+  }
+  InternTable& table = intern_table();
+  auto it = table.lookup.find(str);
+  if (it == table.lookup.end()) {
+    return false;
+  }
+  Id found;
+  found.handle_ = it->second;
+  retain(found.handle_);
+  *id = std::move(found);
+  return true;
+}
+
+void Id::retain(uint32_t handle) {
+  if (handle != 0) {
+    intern_table().entries[handle].refs++;
+  }
+}
+
+void Id::release(uint32_t handle) {
+  if (handle == 0) {
+    return;
+  }
+  InternTable& table = intern_table();
+  InternEntry& entry = table.entries[handle];
+  if (--entry.refs == 0) {
+    table.lookup.erase(entry.str);
+    entry.str.clear();
+    table.free.push_back(handle);
+  }
+}
+
 // StringDecoder
 bool StringDecoder::done() const {
-  return str_ == nullptr || *str_ == 0;
+  return str_.empty();
 }
 
-std::string StringDecoder::upTo(char sep) {
-  const char *p = strchr(str_, sep);
-  if (p == nullptr) {
+std::string_view StringDecoder::upTo(char sep) {
+  size_t pos = str_.find(sep);
+  if (pos == std::string_view::npos) {
     error("Packaged entity decoding failed in upTo()\n");
-    return "";
+    str_ = {};
+    return {};
   }
-  std::string token(str_, p - str_);
-  str_ = p + 1;
+  std::string_view token = str_.substr(0, pos);
+  str_.remove_prefix(pos + 1);
   return token;
 }
 
 int StringDecoder::getInt(char sep) {
-  std::string token = upTo(':');
-  return atoi(token.c_str());
+  int val = 0;
+  for (char c : upTo(sep)) {
+    val = val * 10 + (c - '0');
+  }
+  return val;
 }
 
-std::string StringDecoder::chomp(int len) {
-  // TODO: detect overrun
-  std::string token(str_, len);
-  str_ += len;
+std::string_view StringDecoder::chomp(size_t len) {
+  if (len > str_.size()) {
+    error("Packaged entity decoding failed in chomp()\n");
+    len = str_.size();
+  }
+  std::string_view token = str_.substr(0, len);
+  str_.remove_prefix(len);
   return token;
 }
 
-void StringDecoder::validate(const std::string& token) {
+void StringDecoder::validate(std::string_view token) {
   if (chomp(token.size()) != token) {
     error("Packaged entity decoding failed in validate()\n");
   }
 }
 
+void StringDecoder::skip() {
+  std::string_view type = chomp(1);
+  switch (type.empty() ? 0 : type[0]) {
+    case 'T':
+    case 'U':
+    case 'R':
+      chomp(getInt(':'));
+      break;
+    case 'N':
+      upTo(':');
+      break;
+    case 'B':
+      chomp(1);
+      break;
+    case '-':
+      break;
+    default:
+      error("Packaged entity decoding failed in skip()\n");
+      str_ = {};
+  }
+}
+
+bool StringDecoder::cleared() {
+  if (!str_.empty() && str_[0] == '-') {
+    str_.remove_prefix(1);
+    return true;
+  }
+  return false;
+}
+
 template<>
 void StringDecoder::decode(std::string& text) {
   int len = getInt(':');
-  text = chomp(len);
+  text.assign(chomp(len));
 }
 
 template<>
-void StringDecoder::decode(double& num) {
-  std::string token = upTo(':');
-  num = atof(token.c_str());
+void StringDecoder::decode(Id& id) {
+  int len = getInt(':');
+  id = Id(chomp(len));
 }
 
 template<>
-void StringDecoder::decode(bool& flag) {
-  flag = (chomp(1)[0] == '1');
+void StringDecoder::decode(double& num) {
+  // Numbers are always terminated by ':', so strtod can parse directly from the buffer.
+  std::string_view token = upTo(':');
+  num = token.empty() ? 0 : strtod(token.data(), nullptr);
 }
 
-// Format is <size>:<length>:<value><length>:<value>...
-void StringDecoder::decodeList(const char* str, std::function<void(const std::string&)> callback) {
-  StringDecoder decoder(str);
-  int num = decoder.getInt(':');
-  while (num--) {
-    int len = decoder.getInt(':');
-    std::string chunk = decoder.chomp(len);
-    callback(std::move(chunk));
-  }
+template<>
+void StringDecoder::decode(bool& flag) {
+  std::string_view token = chomp(1);
+  flag = (!token.empty() && token[0] == '1');
 }
 
 Dictionary StringDecoder::decodeDictionary(const char* str) {
   StringDecoder decoder(str);
   Dictionary dict;
   int num = decoder.getInt(':');
-  while (num--) {
+  while (num-- && !decoder.done()) {
     int klen = decoder.getInt(':');
-    std::string key = decoder.chomp(klen);
+    std::string_view key = decoder.chomp(klen);
     int vlen = decoder.getInt(':');
-    std::string val = decoder.chomp(vlen);
-    dict.emplace(std::move(key), std::move(val));
+    std::string_view val = decoder.chomp(vlen);
+    dict.emplace(std::string(key), std::string(val));
   }
   return dict;
 }
 
 // StringEncoder
+// Large enough for any double formatted with "%f" (up to 309 integral digits, plus sign and
+// decimals).
+static constexpr size_t kNumBufSize = 320;
+
+// Formats num into buf in the same way as num_to_str(), returning the length.
+static size_t format_num(double num, char* buf) {
+  int len = snprintf(buf, kNumBufSize, "%f", num);
+  size_t i = len - 1;
+  while (i > 0 && buf[i] == '0') {
+    i--;
+  }
+  return (buf[i] == '.') ? i : i + 1;
+}
+
+// An upper bound on the length of format_num()'s output, so that encoded sizes can be computed
+// without formatting each number twice: the integral digits of 2^exponent (which bounds |num|),
+// plus the sign, decimal point and 6 decimals.
+static size_t max_num_len(double num) {
+  if (!std::isfinite(num)) {
+    return 4;  // "-inf" or "-nan"
+  }
+  int exponent;
+  frexp(num, &exponent);
+  size_t digits = (exponent > 0) ? exponent * 30103 / 100000 + 1 : 1;
+  return digits + 8;
+}
+
+static size_t num_digits(size_t val) {
+  size_t digits = 1;
+  while (val >= 10) {
+    val /= 10;
+    digits++;
+  }
+  return digits;
+}
+
+static void append_int(std::string& str, size_t val) {
+  char buf[20];
+  char* p = buf + sizeof(buf);
+  do {
+    *--p = '0' + val % 10;
+    val /= 10;
+  } while (val);
+  str.append(p, buf + sizeof(buf) - p);
+}
+
+// Appends <length>:<str>.
+static void append_str(std::string& out, std::string_view str) {
+  append_int(out, str.size());
+  out += ':';
+  out += str;
+}
+
 template<>
 void StringEncoder::encode(const char* prefix, const std::string& str) {
-  str_ += prefix + std::to_string(str.size()) + ":" + str + "|";
+  str_ += prefix;
+  append_int(str_, str.size());
+  str_ += ':';
+  str_ += str;
+  str_ += '|';
+}
+
+template<>
+void StringEncoder::encode(const char* prefix, const Id& id) {
+  encode(prefix, id.str());
 }
 
 template<>
 void StringEncoder::encode(const char* prefix, const double& num) {
-  str_ += prefix + num_to_str(num) + ":|";
+  char buf[kNumBufSize];
+  str_ += prefix;
+  str_.append(buf, format_num(num, buf));
+  str_ += ":|";
 }
 
 template<>
 void StringEncoder::encode(const char* prefix, const bool& flag) {
-  str_ += prefix + std::to_string(flag) + "|";
+  str_ += prefix;
+  str_ += flag ? "1|" : "0|";
+}
+
+void StringEncoder::encodeClear(const char* prefix) {
+  str_ += prefix;
+  str_ += "-|";
+}
+
+template<>
+size_t StringEncoder::size(const char* prefix, const std::string& str) const {
+  return strlen(prefix) + num_digits(str.size()) + 1 + str.size() + 1;
+}
+
+template<>
+size_t StringEncoder::size(const char* prefix, const Id& id) const {
+  return size(prefix, id.str());
+}
+
+template<>
+size_t StringEncoder::size(const char* prefix, const double& num) const {
+  return strlen(prefix) + max_num_len(num) + 2;
+}
+
+template<>
+size_t StringEncoder::size(const char* prefix, const bool&) const {
+  return strlen(prefix) + 2;
 }
 
 // Destructive read; clears the internal buffer.
@@ -238,14 +479,209 @@ std::string StringEncoder::result() {
 }
 
 std::string StringEncoder::encodeDictionary(const Dictionary& dict) {
-  std::string encoded = std::to_string(dict.size()) + ":";
-  for (const auto pair : dict) {
-    encoded += std::to_string(pair.first.size()) + ":" + pair.first;
-    encoded += std::to_string(pair.second.size()) + ":" + pair.second;
+  std::string encoded;
+  append_int(encoded, dict.size());
+  encoded += ':';
+  for (const auto& pair : dict) {
+    append_str(encoded, pair.first);
+    append_str(encoded, pair.second);
+  }
+  return encoded;
+}
+
+std::string StringEncoder::encodeDictionaryPatch(const Dictionary& from, const Dictionary& to) {
+  std::vector<const Dictionary::value_type*> changed;
+  for (const auto& pair : to) {
+    auto it = from.find(pair.first);
+    if (it == from.end() || it->second != pair.second) {
+      changed.push_back(&pair);
+    }
+  }
+  std::vector<const std::string*> removed;
+  for (const auto& pair : from) {
+    if (to.count(pair.first) == 0) {
+      removed.push_back(&pair.first);
+    }
+  }
+
+  std::string encoded(1, kTextPatchMarker);
+  append_int(encoded, changed.size());
+  encoded += ':';
+  for (const auto* pair : changed) {
+    append_str(encoded, pair->first);
+    append_str(encoded, pair->second);
+  }
+  append_int(encoded, removed.size());
+  encoded += ':';
+  for (const std::string* key : removed) {
+    append_str(encoded, *key);
   }
   return encoded;
 }
 
+// BinaryDecoder
+BinaryDecoder::BinaryDecoder(const char* str) {
+  uint32_t len;
+  memcpy(&len, str + 1, sizeof(len));
+  cur_ = str + kBinaryHeaderSize;
+  end_ = cur_ + len;
+}
+
+bool BinaryDecoder::done() const {
+  return cur_ >= end_;
+}
+
+bool BinaryDecoder::check(size_t len) {
+  if (len > size_t(end_ - cur_)) {
+    error("Packaged entity decoding failed: binary buffer overrun\n");
+    cur_ = end_;
+    return false;
+  }
+  return true;
+}
+
+uint32_t BinaryDecoder::getVarint() {
+  uint32_t val = 0;
+  for (int shift = 0; cur_ < end_; shift += 7) {
+    uint8_t byte = *cur_++;
+    val |= uint32_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      break;
+    }
+  }
+  return val;
+}
+
+std::string_view BinaryDecoder::chomp(size_t len) {
+  if (!check(len)) {
+    return {};
+  }
+  std::string_view token(cur_, len);
+  cur_ += len;
+  return token;
+}
+
+int BinaryDecoder::field() {
+  uint32_t key = getVarint();
+  wire_type_ = key & 0x7;
+  return key >> 3;
+}
+
+void BinaryDecoder::skip() {
+  switch (wire_type_) {
+    case Varint:
+      getVarint();
+      break;
+    case Fixed64:
+      if (check(8)) cur_ += 8;
+      break;
+    case Bytes: {
+      uint32_t len = getVarint();
+      if (check(len)) cur_ += len;
+      break;
+    }
+    case Clear:
+      break;
+    default:
+      error("Packaged entity decoding failed: unknown wire type %d\n", wire_type_);
+      cur_ = end_;
+  }
+}
+
+template<>
+void BinaryDecoder::decode(std::string& text) {
+  text.assign(chomp(getVarint()));
+}
+
+template<>
+void BinaryDecoder::decode(Id& id) {
+  id = Id(chomp(getVarint()));
+}
+
+template<>
+void BinaryDecoder::decode(double& num) {
+  if (check(sizeof(num))) {
+    memcpy(&num, cur_, sizeof(num));  // wasm is little-endian
+    cur_ += sizeof(num);
+  }
+}
+
+template<>
+void BinaryDecoder::decode(bool& flag) {
+  flag = (getVarint() != 0);
+}
+
+// BinaryEncoder
+BinaryEncoder::BinaryEncoder(char marker) : marker_(marker), str_(kBinaryHeaderSize, marker) {}
+
+void BinaryEncoder::putVarint(uint32_t val) {
+  while (val >= 0x80) {
+    str_ += char((val & 0x7f) | 0x80);
+    val >>= 7;
+  }
+  str_ += char(val);
+}
+
+void BinaryEncoder::encodeString(const std::string& str) {
+  putVarint(str.size());
+  str_ += str;
+}
+
+template<>
+void BinaryEncoder::encode(int field, const std::string& str) {
+  putVarint((field << 3) | Bytes);
+  encodeString(str);
+}
+
+template<>
+void BinaryEncoder::encode(int field, const double& num) {
+  putVarint((field << 3) | Fixed64);
+  str_.append(reinterpret_cast<const char*>(&num), sizeof(num));
+}
+
+template<>
+void BinaryEncoder::encode(int field, const bool& flag) {
+  putVarint((field << 3) | Varint);
+  str_ += char(flag);
+}
+
+size_t BinaryEncoder::varintSize(uint32_t val) {
+  size_t size = 1;
+  while (val >= 0x80) {
+    val >>= 7;
+    size++;
+  }
+  return size;
+}
+
+size_t BinaryEncoder::stringSize(const std::string& str) const {
+  return varintSize(str.size()) + str.size();
+}
+
+template<>
+size_t BinaryEncoder::size(int field, const std::string& str) const {
+  return varintSize((field << 3) | Bytes) + stringSize(str);
+}
+
+template<>
+size_t BinaryEncoder::size(int field, const double&) const {
+  return varintSize((field << 3) | Fixed64) + sizeof(double);
+}
+
+template<>
+size_t BinaryEncoder::size(int field, const bool&) const {
+  return varintSize((field << 3) | Varint) + 1;
+}
+
+// Destructive read; fills in the header and resets the internal buffer.
+std::string BinaryEncoder::result() {
+  uint32_t len = str_.size() - kBinaryHeaderSize;
+  memcpy(&str_[1], &len, sizeof(len));
+  std::string res = std::move(str_);
+  str_.assign(kBinaryHeaderSize, marker_);
+  return res;
+}
+
 // StringPrinter
 void StringPrinter::addId(const std::string& id) {
   parts_.push_back("{" + id + "}");
@@ -285,23 +721,166 @@ std::string StringPrinter::result(const char* join) {
   return res;
 }
 
+// SlotIndex
+void SlotIndex::insert(uint32_t hash, uint32_t slot) {
+  // Keep the load factor at or below 1/2.
+  if (2 * (size_ + 1) > buckets_.size()) {
+    grow();
+  }
+  size_t mask = buckets_.size() - 1;
+  size_t i = hash & mask;
+  while (buckets_[i].slot != kNone) {
+    i = (i + 1) & mask;
+  }
+  buckets_[i] = {hash, slot};
+  size_++;
+}
+
+void SlotIndex::erase(uint32_t hash, uint32_t slot) {
+  size_t i = position(hash, slot);
+  if (i == buckets_.size()) {
+    return;
+  }
+  // Shift back any following entries in the probe sequence that would otherwise become
+  // unreachable, i.e. those whose home bucket is not cyclically within (i, j].
+  size_t mask = buckets_.size() - 1;
+  for (size_t j = (i + 1) & mask; buckets_[j].slot != kNone; j = (j + 1) & mask) {
+    size_t home = buckets_[j].hash & mask;
+    bool reachable = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+    if (!reachable) {
+      buckets_[i] = buckets_[j];
+      i = j;
+    }
+  }
+  buckets_[i].slot = kNone;
+  size_--;
+}
+
+void SlotIndex::move(uint32_t hash, uint32_t from, uint32_t to) {
+  size_t i = position(hash, from);
+  if (i != buckets_.size()) {
+    buckets_[i].slot = to;
+  }
+}
+
+void SlotIndex::clear() {
+  buckets_.clear();
+  size_ = 0;
+}
+
+// Returns the bucket position for the given slot, or buckets_.size() if not found.
+size_t SlotIndex::position(uint32_t hash, uint32_t slot) const {
+  if (!buckets_.empty()) {
+    size_t mask = buckets_.size() - 1;
+    for (size_t i = hash & mask; buckets_[i].slot != kNone; i = (i + 1) & mask) {
+      if (buckets_[i].slot == slot) {
+        return i;
+      }
+    }
+  }
+  return buckets_.size();
+}
+
+void SlotIndex::grow() {
+  std::vector<Bucket> old = std::move(buckets_);
+  buckets_.assign(std::max<size_t>(16, 2 * old.size()), Bucket{0, kNone});
+  size_ = 0;
+  for (const Bucket& bucket : old) {
+    if (bucket.slot != kNone) {
+      insert(bucket.hash, bucket.slot);
+    }
+  }
+}
+
+void Bitmap::resize(size_t size) {
+  words_.resize((size + 31) / 32, 0);
+  // Clear any bits left past the new size so the tail word stays clean when growing again.
+  if (size < size_ && size % 32 != 0) {
+    words_.back() &= (uint32_t(1) << (size % 32)) - 1;
+  }
+  size_ = size;
+}
+
+size_t Bitmap::count() const {
+  size_t count = 0;
+  for (uint32_t word : words_) {
+    count += __builtin_popcount(word);
+  }
+  return count;
+}
+
+std::string encodeWriteBatch(const std::vector<PendingWrite>& writes) {
+  // Allow for the kind and length prefix of each write.
+  size_t size = 0;
+  for (const PendingWrite& write : writes) {
+    size += write.encoded.size() + 12;
+  }
+  std::string encoded;
+  encoded.reserve(size);
+  for (const PendingWrite& write : writes) {
+    if (write.kind == PendingWrite::kNone) {
+      continue;
+    }
+    encoded += char(write.kind);
+    if (write.kind != PendingWrite::kClear) {
+      encoded += std::to_string(write.encoded.size());
+      encoded += ':';
+      encoded += write.encoded;
+    }
+  }
+  return encoded;
+}
+
+static constexpr int kTemplateIdSize = 17;
+
+// 64-bit FNV-1a; templates are identified by the hash of their content.
+static uint64_t hash_template(std::string_view str) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (char c : str) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// Writes the template id for a hash as 16 hex digits plus a null terminator.
+static void format_template_id(uint64_t hash, char* buf) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  for (int i = kTemplateIdSize - 2; i >= 0; i--) {
+    buf[i] = kHexDigits[hash & 0xf];
+    hash >>= 4;
+  }
+  buf[kTemplateIdSize - 1] = 0;
+}
+
 }  // namespace internal
 
 // --- Entity helpers ---
 
 std::string num_to_str(double num) {
-  std::string s = std::to_string(num);
-  auto i = s.size() - 1;
-  while (i > 0 && s[i] == '0') {
-    i--;
-  }
-  s.erase((s[i] == '.') ? i : i + 1);
-  return s;
+  char buf[internal::kNumBufSize];
+  return std::string(buf, internal::format_num(num, buf));
 }
 
 // --- Storage classes ---
 
 // Handle
+std::string Handle::newId() {
+  if (ids_left_ == 0) {
+    const char* prefix = internal::leaseIds(particle_, this);
+    if (prefix == nullptr) {
+      error("Handle '%s' failed to lease entity ids\n", name_.c_str());
+      return "";
+    }
+    id_prefix_ = prefix;
+    free((void*)prefix);
+    next_id_ = 0;
+    ids_left_ = kIdLeaseSize;
+  }
+  ids_left_--;
+  return id_prefix_ + std::to_string(next_id_++);
+}
+
 bool Handle::failForDirection(Direction bad_dir) const {
   if (dir_ == bad_dir) {
     std::string action = (bad_dir == In) ? "write to" : "read from";
@@ -313,6 +892,53 @@ bool Handle::failForDirection(Direction bad_dir) const {
   return false;
 }
 
+// ModelWriter
+ModelWriter::ModelWriter() : encoded_(1, 'M') {}
+
+ModelWriter& ModelWriter::set(std::string_view key, std::string_view value) {
+  appendKey(key);
+  encoded_ += 'T';
+  internal::append_str(encoded_, value);
+  return *this;
+}
+
+ModelWriter& ModelWriter::set(std::string_view key, bool value) {
+  appendKey(key);
+  encoded_ += value ? "B1" : "B0";
+  return *this;
+}
+
+ModelWriter& ModelWriter::setNumber(std::string_view key, double value) {
+  char buf[internal::kNumBufSize];
+  appendKey(key);
+  encoded_ += 'N';
+  encoded_.append(buf, internal::format_num(value, buf));
+  encoded_ += ':';
+  return *this;
+}
+
+void ModelWriter::beginList(std::string_view key, std::string_view template_name) {
+  appendKey(key);
+  encoded_ += '[';
+  internal::append_str(encoded_, template_name);
+}
+
+void ModelWriter::beginRecord() {
+  encoded_ += '{';
+}
+
+void ModelWriter::endRecord() {
+  encoded_ += '}';
+}
+
+void ModelWriter::endList() {
+  encoded_ += ']';
+}
+
+void ModelWriter::appendKey(std::string_view key) {
+  internal::append_str(encoded_, key);
+}
+
 // Particle
 void Particle::registerHandle(std::string name, Handle& handle) {
   handle.name_ = std::move(name);
@@ -324,12 +950,18 @@ void Particle::autoRender(const std::string& slot_name) {
   auto_render_slot_ = slot_name;
 }
 
-Handle* Particle::connectHandle(const char* name, bool can_read, bool can_write) {
+Handle* Particle::connectHandle(const char* name, bool can_read, bool can_write,
+                                const char* id_prefix) {
   auto pair = handles_.find(name);
   if (pair == handles_.end()) {
     return nullptr;
   }
   Handle* handle = pair->second;
+  if (id_prefix != nullptr) {
+    handle->id_prefix_ = id_prefix;
+    handle->next_id_ = 0;
+    handle->ids_left_ = Handle::kIdLeaseSize;
+  }
   if (can_read) {
     to_sync_.insert(handle);
     handle->dir_ = can_write ? InOut : In;
@@ -342,32 +974,116 @@ Handle* Particle::connectHandle(const char* name, bool can_read, bool can_write)
 void Particle::sync(Handle* handle) {
   to_sync_.erase(handle);
   onHandleSync(handle->name(), to_sync_.empty());
-  if (to_sync_.empty() && !auto_render_slot_.empty()) {
-    renderSlot(auto_render_slot_);
+  if (to_sync_.empty()) {
+    scheduleAutoRender();
   }
 }
 
 void Particle::update(Handle* handle) {
   onHandleUpdate(handle->name());
-  if (!auto_render_slot_.empty()) {
-    renderSlot(auto_render_slot_);
+  scheduleAutoRender();
+}
+
+void Particle::flushRender() {
+  if (render_scheduled_) {
+    render_scheduled_ = false;
+    render(auto_render_slot_, true, true, true);
+  }
+}
+
+void Particle::scheduleAutoRender() {
+  if (!auto_render_slot_.empty() && !render_scheduled_) {
+    render_scheduled_ = true;
+    internal::scheduleRender(this);
   }
 }
 
 void Particle::renderSlot(const std::string& slot_name, bool send_template, bool send_model) {
-  const char* template_ptr = nullptr;
+  render(slot_name, send_template, send_model, false);
+}
+
+void Particle::requestRender(const char* slot_name, bool send_template, bool send_model) {
+  rendered_.erase(slot_name);
+  render(slot_name, send_template, send_model, false);
+}
+
+void Particle::render(const std::string& slot_name, bool send_template, bool send_model,
+                      bool skip_unchanged) {
+  RenderedSlot& last = rendered_[slot_name];
+  bool changed = false;
+
+  // Templates provided by getTemplateView() are expected to be stable, so the hash is only
+  // computed when the view changes.
   std::string template_str;
+  std::string_view template_view;
+  uint64_t template_hash = 0;
   if (send_template) {
-    template_str = getTemplate(slot_name);
-    template_ptr = template_str.c_str();
+    template_view = getTemplateView(slot_name);
+    if (template_view.data() != nullptr && last.has_template &&
+        template_view.data() == last.template_view.data() &&
+        template_view.size() == last.template_view.size()) {
+      template_hash = last.template_hash;
+    } else if (template_view.data() != nullptr) {
+      template_hash = internal::hash_template(template_view);
+    } else {
+      template_str = getTemplate(slot_name);
+      template_hash = internal::hash_template(template_str);
+    }
+    changed = !last.has_template || template_hash != last.template_hash;
+  }
+
+  Dictionary dict;
+  ModelWriter writer;
+  if (send_model) {
+    writeModel(slot_name, &writer);
+    if (!writer.empty()) {
+      changed = changed || !last.typed_model || writer.encoded() != last.encoded_model;
+    } else {
+      populateModel(slot_name, &dict);
+      changed = changed || last.typed_model || dict != last.model;
+    }
+    changed = changed || !last.has_model;
+  }
+
+  if (skip_unchanged && !changed) {
+    return;
   }
 
+  // Each distinct template is sent to the host once per particle; renders refer to it by id.
+  char template_id[internal::kTemplateIdSize];
+  const char* template_ptr = nullptr;
+  if (send_template) {
+    internal::format_template_id(template_hash, template_id);
+    if (registered_templates_.insert(template_hash).second) {
+      std::string_view content = (template_view.data() != nullptr) ? template_view : template_str;
+      internal::registerTemplate(this, template_id, content.data(), content.size());
+    }
+    last.template_view = template_view;
+    last.template_hash = template_hash;
+    last.has_template = true;
+    template_ptr = template_id;
+  }
+
+  // Typed models are always sent whole. After the first Dictionary model sent for a slot, only the
+  // entries that differ from the previous one are sent; the host merges them into its copy.
   const char* model_ptr = nullptr;
   std::string model;
-  if (send_model) {
-    Dictionary dict;
-    populateModel(slot_name, &dict);
-    model = internal::StringEncoder::encodeDictionary(dict);
+  if (send_model && !writer.empty()) {
+    last.encoded_model = writer.release();
+    last.model.clear();
+    last.has_model = true;
+    last.typed_model = true;
+    model_ptr = last.encoded_model.c_str();
+  } else if (send_model) {
+    if (last.has_model && !last.typed_model) {
+      model = internal::StringEncoder::encodeDictionaryPatch(last.model, dict);
+    } else {
+      model = internal::StringEncoder::encodeDictionary(dict);
+    }
+    last.model = std::move(dict);
+    last.encoded_model.clear();
+    last.has_model = true;
+    last.typed_model = false;
     model_ptr = model.c_str();
   }
 
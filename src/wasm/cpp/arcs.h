@@ -2,12 +2,16 @@
 #define _ARCS_H
 
 #include <emscripten.h>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
 #include <memory>
+#include <set>
+#include <type_traits>
 
 namespace arcs {
 
@@ -17,6 +21,8 @@ using Dictionary = std::unordered_map<std::string, std::string>;
 class Handle;
 class Particle;
 template<typename T> class Ref;
+template<typename T> class Collection;
+template<typename L, typename R, typename J> class Join;
 
 namespace internal {
 extern "C" {
@@ -24,14 +30,31 @@ extern "C" {
 // --- Wasm-to-JS API ---
 
 // singletonSet and collectionStore will create ids for entities if required, and will return
-// the new ids in allocated memory that the Handle implementations will free.
+// the new ids in allocated memory that the Handle implementations will free. Handles normally
+// create ids locally (see leaseIds), so this is only a fallback.
 extern const char* singletonSet(Particle* p, Handle* h, const char* encoded);
 extern void singletonClear(Particle* p, Handle* h);
+// Updates the singleton's current entity with a patch from Accessor::diff_entity().
+extern void singletonPatch(Particle* p, Handle* h, const char* encoded);
 extern const char* collectionStore(Particle* p, Handle* h, const char* encoded);
-extern void collectionRemove(Particle* p, Handle* h, const char* encoded);
+extern void collectionRemoveById(Particle* p, Handle* h, const char* id);
 extern void collectionClear(Particle* p, Handle* h);
+// Applies a sequence of collection writes encoded by encodeWriteBatch(); see below.
+extern void collectionApplyBatch(Particle* p, Handle* h, const char* encoded, size_t length);
+// Returns a new unique prefix for the ids of entities written to the handle, in allocated memory
+// that the Handle will free.
+extern const char* leaseIds(Particle* p, Handle* h);
 extern void dereference(Particle* p, Handle* h, const char* ref_id, size_t continuation_id);
-extern void render(Particle* p, const char* slotName, const char* template_str, const char* model);
+// Asks the runtime to call Particle::flushRender(); the runtime may defer the call in order to
+// batch the renders of several particles.
+extern void scheduleRender(Particle* p);
+// Registers a template under an id derived from its content; 'template_str' need not be
+// null-terminated.
+extern void registerTemplate(Particle* p, const char* template_id, const char* template_str,
+                             size_t length);
+// 'template_id' refers to a previously registered template, or is null to leave the slot's
+// template unchanged.
+extern void render(Particle* p, const char* slotName, const char* template_id, const char* model);
 extern void serviceRequest(Particle* p, const char* call, const char* args, const char* tag);
 
 // Returns allocated memory that the Particle base class will free.
@@ -46,9 +69,22 @@ extern void systemError(const char* msg);
 // --- Packaging classes ---
 // Used by the code generated from Schema definitions to pack and unpack serialized data.
 
+// Entity data can be transferred in either a human-readable text format or a more compact binary
+// format; see the comments at the top of src/runtime/wasm.ts for details. Decoding detects the
+// format automatically. Encoding uses the format negotiated with the host at startup (text is
+// always supported and is the default).
+enum class WireFormat { Text = 0, Binary = 1 };
+
+// Returns the wire format to use when sending entity data to the host.
+WireFormat wireFormat();
+
+// Decodes the text format in place: tokens, list chunks and dictionary entries are returned as
+// views into the source buffer (usually the host-provided string in wasm linear memory), so the
+// only copies made are for the final field values.
 class StringDecoder {
 public:
-  StringDecoder(const char* str) : str_(str) {}
+  StringDecoder(const char* str) : str_(str != nullptr ? str : "") {}
+  StringDecoder(std::string_view str) : str_(str) {}
 
   StringDecoder(StringDecoder&) = delete;
   StringDecoder(const StringDecoder&) = delete;
@@ -56,18 +92,139 @@ public:
   StringDecoder& operator=(const StringDecoder&) = delete;
 
   bool done() const;
-  std::string upTo(char sep);
+  std::string_view upTo(char sep);
   int getInt(char sep);
-  std::string chomp(int len);
-  void validate(const std::string& token);
+  std::string_view chomp(size_t len);
+  void validate(std::string_view token);
+
+  // Skips the type char and value of a field that the decoding entity class doesn't recognize.
+  void skip();
+
+  // For patches: returns true, consuming the marker, if the current field was cleared rather than
+  // given a new value.
+  bool cleared();
+
   template<typename T> void decode(T& val);
-  template<typename T> void decode(Ref<T>& ref) {}  // TODO
+  // Reference fields hold a nested reference: R<length>:<id-length>:<id>|<key-length>:<key>|
+  template<typename T> void decode(Ref<T>& ref);
+
+  // Format is <size>:<length>:<value><length>:<value>...
+  template<typename F>
+  static void decodeList(const char* str, F&& callback) {
+    StringDecoder decoder(str);
+    int num = decoder.getInt(':');
+    while (num-- && !decoder.done()) {
+      int len = decoder.getInt(':');
+      callback(decoder.chomp(len));
+    }
+  }
 
-  static void decodeList(const char* str, std::function<void(const std::string&)> callback);
   static Dictionary decodeDictionary(const char* str);
 
 private:
-  const char* str_;
+  std::string_view str_;
+};
+
+// Binary-encoded buffers start with this marker (the format version), followed by the payload
+// length as a 4-byte little-endian integer. Text-encoded data always starts with a digit.
+static constexpr char kBinaryMarker = 1;
+static constexpr size_t kBinaryHeaderSize = 5;
+
+// Patches (see Accessor::diff_entity) start with one of these instead, depending on the format.
+static constexpr char kTextPatchMarker = 'P';
+static constexpr char kBinaryPatchMarker = 2;
+
+// Field keys in the binary format combine the schema field index with one of these wire types,
+// allowing unrecognized fields to be skipped without knowing their schema type. Clear is only
+// used in patches, and has no value.
+enum WireType { Varint = 0, Fixed64 = 1, Bytes = 2, Clear = 3 };
+
+class BinaryDecoder {
+public:
+  // Reads the header of a top-level binary buffer.
+  BinaryDecoder(const char* str);
+
+  // Wraps a nested payload (e.g. an entity within a collection).
+  BinaryDecoder(const char* start, size_t len) : cur_(start), end_(start + len) {}
+
+  BinaryDecoder(BinaryDecoder&) = delete;
+  BinaryDecoder(const BinaryDecoder&) = delete;
+  BinaryDecoder& operator=(BinaryDecoder&) = delete;
+  BinaryDecoder& operator=(const BinaryDecoder&) = delete;
+
+  static bool matches(const char* str) { return str != nullptr && *str == kBinaryMarker; }
+
+  bool done() const;
+  uint32_t getVarint();
+  std::string_view chomp(size_t len);
+
+  // Reads a field key, returning the field index. The value must then be consumed using either
+  // decode() or skip().
+  int field();
+  void skip();
+
+  // For patches: returns true if the current field was cleared, in which case it has no value.
+  bool cleared() const { return wire_type_ == Clear; }
+
+  template<typename T> void decode(T& val);
+  // Reference fields are Bytes fields holding a nested <varint:id-length><id><varint:key-length><key>.
+  template<typename T> void decode(Ref<T>& ref);
+
+  // Payload format is <varint:size><varint:length><value><varint:length><value>...
+  template<typename F>
+  static void decodeList(const char* str, F&& callback) {
+    BinaryDecoder decoder(str);
+    uint32_t num = decoder.getVarint();
+    while (num--) {
+      uint32_t len = decoder.getVarint();
+      if (!decoder.check(len)) {
+        return;
+      }
+      BinaryDecoder chunk(decoder.cur_, len);
+      decoder.cur_ += len;
+      callback(chunk);
+    }
+  }
+
+private:
+  bool check(size_t len);
+
+  const char* cur_;
+  const char* end_;
+  int wire_type_ = Bytes;
+};
+
+class BinaryEncoder {
+public:
+  explicit BinaryEncoder(char marker = kBinaryMarker);
+
+  BinaryEncoder(BinaryEncoder&) = delete;
+  BinaryEncoder(const BinaryEncoder&) = delete;
+  BinaryEncoder& operator=(BinaryEncoder&) = delete;
+  BinaryEncoder& operator=(const BinaryEncoder&) = delete;
+
+  // Pre-sizes the buffer for a payload of the given length (see Accessor::encoded_size).
+  void reserve(size_t size) { str_.reserve(kBinaryHeaderSize + size); }
+
+  void putVarint(uint32_t val);
+
+  // Writes a length-prefixed string without a field key; used for entity ids and storage keys.
+  void encodeString(const std::string& str);
+
+  template<typename T> void encode(int field, const T& val);
+  template<typename T> void encode(int field, const Ref<T>& ref);
+  void encodeClear(int field) { putVarint((field << 3) | Clear); }
+  std::string result();
+
+  // Return the number of bytes the corresponding methods above will write.
+  static size_t varintSize(uint32_t val);
+  size_t stringSize(const std::string& str) const;
+  template<typename T> size_t size(int field, const T& val) const;
+  template<typename T> size_t size(int field, const Ref<T>& ref) const;
+
+private:
+  char marker_;
+  std::string str_;
 };
 
 class StringEncoder {
@@ -79,12 +236,25 @@ public:
   StringEncoder& operator=(StringEncoder&) = delete;
   StringEncoder& operator=(const StringEncoder&) = delete;
 
+  // Pre-sizes the buffer (see Accessor::encoded_size).
+  void reserve(size_t size) { str_.reserve(size); }
+
   template<typename T> void encode(const char* prefix, const T& val);
-  template<typename T> void encode(const char* prefix, const Ref<T>& ref) {}  // TODO
+  template<typename T> void encode(const char* prefix, const Ref<T>& ref);
+  void encodeClear(const char* prefix);
   std::string result();
 
+  // Returns the number of chars encode() will write for the given value. For numbers this is an
+  // upper bound, since computing the exact length would require formatting them twice.
+  template<typename T> size_t size(const char* prefix, const T& val) const;
+  template<typename T> size_t size(const char* prefix, const Ref<T>& ref) const;
+
   static std::string encodeDictionary(const Dictionary& dict);
 
+  // Encodes the entries of 'to' that are new or differ from 'from', then the keys that were
+  // removed: P<dictionary><num-removed>:<key-len>:<key><key-len>:<key>...
+  static std::string encodeDictionaryPatch(const Dictionary& from, const Dictionary& to);
+
 private:
   std::string str_;
 };
@@ -109,6 +279,60 @@ private:
   std::vector<std::string> parts_;
 };
 
+// Interned string used for entity ids and storage keys. Equal strings share a single 32-bit
+// handle into a module-wide table, so copying, equality and hashing are integer operations and
+// the text is only looked up when encoding or printing. Table entries are reference counted and
+// recycled when the last Id using them is destroyed.
+class Id {
+public:
+  Id() = default;
+  Id(std::string_view str) : handle_(intern(str)) {}
+  Id(const std::string& str) : handle_(intern(str)) {}
+  Id(const char* str) : handle_(str != nullptr ? intern(str) : 0) {}
+
+  Id(const Id& other) : handle_(other.handle_) { retain(handle_); }
+  Id(Id&& other) noexcept : handle_(other.handle_) { other.handle_ = 0; }
+  ~Id() { release(handle_); }
+
+  Id& operator=(const Id& other) {
+    retain(other.handle_);
+    release(handle_);
+    handle_ = other.handle_;
+    return *this;
+  }
+
+  Id& operator=(Id&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
+  // Sets *id to the Id for str without interning it, returning false if str is not currently in
+  // use as an Id (in which case no entity can have it).
+  static bool lookup(std::string_view str, Id* id);
+
+  const std::string& str() const;
+  operator const std::string&() const { return str(); }
+
+  bool empty() const { return handle_ == 0; }
+  uint32_t hash() const { return handle_; }
+
+  // Lexicographic ordering, short-circuited for identical handles.
+  int compare(const Id& other) const {
+    return (handle_ == other.handle_) ? 0 : str().compare(other.str());
+  }
+
+  friend bool operator==(const Id& a, const Id& b) { return a.handle_ == b.handle_; }
+  friend bool operator!=(const Id& a, const Id& b) { return a.handle_ != b.handle_; }
+
+private:
+  static uint32_t intern(std::string_view str);
+  static void retain(uint32_t handle);
+  static void release(uint32_t handle);
+
+  // Handle 0 is always the empty string and is not reference counted.
+  uint32_t handle_ = 0;
+};
+
 // Hash combining borrowed from Boost.
 template<typename T>
 void hash_combine(std::size_t& seed, const T& v) {
@@ -120,6 +344,68 @@ void hash_combine(std::size_t& seed, const T& v) {
   seed ^= std::hash<T>()(v) + magic + (seed << 6) + (seed >> 2);
 }
 
+inline void hash_combine(std::size_t& seed, const Id& id) {
+  hash_combine(seed, id.hash());
+}
+
+}  // namespace internal
+}  // namespace arcs
+
+// For STL unordered associative containers.
+template<>
+struct std::hash<arcs::internal::Id> {
+  size_t operator()(const arcs::internal::Id& id) const {
+    return id.hash();
+  }
+};
+
+namespace arcs {
+namespace internal {
+
+// Fixed-size set of field validity bits for the generated entity classes. Uses the narrowest
+// integer that holds N bits (so most entities pay a single byte), falling back to an array of
+// 32-bit words for wide schemas.
+template<int N, typename Enable = void>
+class FieldMask {
+public:
+  bool test(int i) const { return (words_[i / 32] >> (i % 32)) & 1; }
+  void set(int i) { words_[i / 32] |= uint32_t(1) << (i % 32); }
+  void reset(int i) { words_[i / 32] &= ~(uint32_t(1) << (i % 32)); }
+  void clear() { for (uint32_t& w : words_) w = 0; }
+
+  friend bool operator==(const FieldMask& a, const FieldMask& b) {
+    for (int i = 0; i < kWords; i++) {
+      if (a.words_[i] != b.words_[i]) return false;
+    }
+    return true;
+  }
+  friend bool operator!=(const FieldMask& a, const FieldMask& b) { return !(a == b); }
+
+private:
+  static constexpr int kWords = (N + 31) / 32;
+  uint32_t words_[kWords] = {};
+};
+
+template<int N>
+class FieldMask<N, std::enable_if_t<(N <= 32)>> {
+public:
+  using Word = std::conditional_t<(N <= 8), uint8_t, std::conditional_t<(N <= 16), uint16_t, uint32_t>>;
+
+  bool test(int i) const { return (bits_ >> i) & 1; }
+  void set(int i) { bits_ |= Word(1) << i; }
+  void reset(int i) { bits_ &= ~(Word(1) << i); }
+  void clear() { bits_ = 0; }
+
+  friend bool operator==(const FieldMask& a, const FieldMask& b) { return a.bits_ == b.bits_; }
+  friend bool operator!=(const FieldMask& a, const FieldMask& b) { return a.bits_ != b.bits_; }
+
+private:
+  Word bits_ = 0;
+};
+
+template<typename T> struct IsRef : std::false_type {};
+template<typename T> struct IsRef<Ref<T>> : std::true_type {};
+
 // Various bits of code need private access to the generated entity classes. Wrapping them as
 // static methods in a class simplifies things: it only requires a single friend directive, and
 // allows partial specialization where standalone template functions do not.
@@ -155,14 +441,149 @@ public:
   // -- Data transport methods --
 
   template<typename T>
-  static void decode_entity(T* entity, const char* str) {
+  static const Id& id(const T& entity) {
+    return entity._internal_id_;
+  }
+
+  // Gives an entity the id of another, so that storing it replaces the other in its handle.
+  template<typename T>
+  static void copy_id(T* entity, const T& from) {
+    entity->_internal_id_ = from._internal_id_;
+  }
+
+  // Clears all fields and the id, keeping any allocated string storage for reuse.
+  template<typename T>
+  static void reset_entity(T* entity) {
+    static_assert(sizeof(T) == 0, "Only schema-specific implementations of reset_entity can be used");
+  }
+
+  template<typename T>
+  static void decode_entity(T* entity, StringDecoder& decoder) {
     static_assert(sizeof(T) == 0, "Only schema-specific implementations of decode_entity can be used");
   }
 
   template<typename T>
-  static std::string encode_entity(const T& entity) {
+  static void decode_entity(T* entity, BinaryDecoder& decoder) {
+    static_assert(sizeof(T) == 0, "Only schema-specific implementations of decode_entity can be used");
+  }
+
+  template<typename T>
+  static void encode_entity(const T& entity, StringEncoder& encoder) {
     static_assert(sizeof(T) == 0, "Only schema-specific implementations of encode_entity can be used");
-    return "";
+  }
+
+  template<typename T>
+  static void encode_entity(const T& entity, BinaryEncoder& encoder) {
+    static_assert(sizeof(T) == 0, "Only schema-specific implementations of encode_entity can be used");
+  }
+
+  // Returns the length of the data encode_entity() will write with the given encoder, not
+  // including the binary format's header. Exact for the binary format; an upper bound for text.
+  template<typename T>
+  static size_t encoded_size(const T& entity, const StringEncoder& encoder) {
+    static_assert(sizeof(T) == 0, "Only schema-specific implementations of encoded_size can be used");
+    return 0;
+  }
+
+  template<typename T>
+  static size_t encoded_size(const T& entity, const BinaryEncoder& encoder) {
+    static_assert(sizeof(T) == 0, "Only schema-specific implementations of encoded_size can be used");
+    return 0;
+  }
+
+  // Writes the fields of 'to' that differ from 'from', and a clear for each field set in 'from'
+  // but not in 'to'. The id is written by the wrapper below.
+  template<typename T>
+  static void diff_entity(const T& from, const T& to, StringEncoder& encoder) {
+    static_assert(sizeof(T) == 0, "Only schema-specific implementations of diff_entity can be used");
+  }
+
+  template<typename T>
+  static void diff_entity(const T& from, const T& to, BinaryEncoder& encoder) {
+    static_assert(sizeof(T) == 0, "Only schema-specific implementations of diff_entity can be used");
+  }
+
+  template<typename T>
+  static void apply_patch(T* entity, StringDecoder& decoder) {
+    static_assert(sizeof(T) == 0, "Only schema-specific implementations of apply_patch can be used");
+  }
+
+  template<typename T>
+  static void apply_patch(T* entity, BinaryDecoder& decoder) {
+    static_assert(sizeof(T) == 0, "Only schema-specific implementations of apply_patch can be used");
+  }
+
+  // Decodes a serialized entity in either wire format.
+  template<typename T>
+  static void decode_entity(T* entity, const char* str) {
+    if (str == nullptr) return;
+    if (BinaryDecoder::matches(str)) {
+      BinaryDecoder decoder(str);
+      decode_entity(entity, decoder);
+    } else {
+      StringDecoder decoder(str);
+      decode_entity(entity, decoder);
+    }
+  }
+
+  template<typename T>
+  static std::string encode_entity(const T& entity, WireFormat format = WireFormat::Text) {
+    if (format == WireFormat::Binary) {
+      BinaryEncoder encoder;
+      encoder.reserve(encoded_size(entity, encoder));
+      encode_entity(entity, encoder);
+      return encoder.result();
+    } else {
+      StringEncoder encoder;
+      encoder.reserve(encoded_size(entity, encoder));
+      encode_entity(entity, encoder);
+      return encoder.result();
+    }
+  }
+
+  // Encodes a patch that turns 'from' into 'to', for a receiver that already holds 'from'. Only
+  // the changed fields are included; the patch carries the id of 'to', which should match 'from'.
+  //   text:    P<id-length>:<id>|<name>:<value>|<name>:-|...   ('-' marks a cleared field)
+  //   binary:  <marker:u8=2><payload-length:u32le><varint:id-length><id><field>...
+  template<typename T>
+  static std::string diff_entity(const T& from, const T& to, WireFormat format = WireFormat::Text) {
+    if (format == WireFormat::Binary) {
+      BinaryEncoder encoder(kBinaryPatchMarker);
+      encoder.encodeString(to._internal_id_);
+      diff_entity(from, to, encoder);
+      return encoder.result();
+    } else {
+      static constexpr char prefix[] = {kTextPatchMarker, 0};
+      StringEncoder encoder;
+      encoder.encode(prefix, to._internal_id_);
+      diff_entity(from, to, encoder);
+      return encoder.result();
+    }
+  }
+
+  static bool is_patch(const char* str) {
+    return str != nullptr && (*str == kTextPatchMarker || *str == kBinaryPatchMarker);
+  }
+
+  // Applies a patch from diff_entity() in place. Returns false, leaving the entity unchanged, if
+  // the patch is for a different entity.
+  template<typename T>
+  static bool apply_patch(T* entity, const char* str) {
+    if (!is_patch(str)) return false;
+    Id id;
+    if (*str == kBinaryPatchMarker) {
+      BinaryDecoder decoder(str);
+      decoder.decode(id);
+      if (id != entity->_internal_id_) return false;
+      apply_patch(entity, decoder);
+    } else {
+      StringDecoder decoder(str + 1);
+      decoder.decode(id);
+      decoder.validate("|");
+      if (id != entity->_internal_id_) return false;
+      apply_patch(entity, decoder);
+    }
+    return true;
   }
 
   // -- Test methods --
@@ -190,14 +611,38 @@ public:
   template<typename T> static size_t hash_entity(const Ref<T>& ref);
   template<typename T> static bool fields_equal(const Ref<T>& a, const Ref<T>& b);
   template<typename T> static std::string entity_to_str(const Ref<T>& ref, const char* join);
-  template<typename T> static void decode_entity(Ref<T>* ref, const char* str);
-  template<typename T> static std::string encode_entity(const Ref<T>& ref);
+  template<typename T> static void reset_entity(Ref<T>* ref);
+  template<typename T> static void decode_entity(Ref<T>* ref, StringDecoder& decoder);
+  template<typename T> static void decode_entity(Ref<T>* ref, BinaryDecoder& decoder);
+  template<typename T> static void encode_entity(const Ref<T>& ref, StringEncoder& encoder);
+  template<typename T> static void encode_entity(const Ref<T>& ref, BinaryEncoder& encoder);
+  template<typename T> static size_t encoded_size(const Ref<T>& ref, const StringEncoder& encoder);
+  template<typename T> static size_t encoded_size(const Ref<T>& ref, const BinaryEncoder& encoder);
   template<typename T> static const std::string& get_id(const Ref<T>& ref);
   template<typename T> static void set_id(Ref<T>* ref, const std::string& id);
 };
 
-// Wrapper type for user-provided dereference continuations.
-using DerefContinuation = std::function<void(const char*)>;
+// A pending dereference request: decodes the retrieved entity data into the target (a Ref's
+// shared payload) then runs the user-provided continuation. The target is type-erased with a
+// plain function pointer so no wrapper lambda needs to be allocated around the continuation.
+class DerefContinuation {
+public:
+  using DecodeFn = void (*)(void* target, const char* encoded);
+
+  DerefContinuation() = default;
+  DerefContinuation(std::shared_ptr<void> target, DecodeFn decode, std::function<void()> fn)
+      : target_(std::move(target)), decode_(decode), fn_(std::move(fn)) {}
+
+  void operator()(const char* encoded) const {
+    decode_(target_.get(), encoded);
+    fn_();
+  }
+
+private:
+  std::shared_ptr<void> target_;
+  DecodeFn decode_ = nullptr;
+  std::function<void()> fn_;
+};
 
 }  // namespace internal
 
@@ -251,6 +696,28 @@ std::string num_to_str(double num);
 
 enum Direction { Unconnected, In, Out, InOut };
 
+class WriteBatch;
+
+namespace internal {
+
+// A write deferred by a WriteBatch; writes superseded by later ones in the same batch are
+// marked with kNone. kPatch is only used by Singletons.
+struct PendingWrite {
+  enum Kind : char { kNone = 0, kStore = 'S', kRemove = 'R', kClear = 'C', kPatch = 'P' };
+
+  Kind kind;
+  std::string encoded;
+};
+
+// Encodes the writes for collectionApplyBatch:
+//   <batch> = <write><write>...
+//   <write> = S<length>:<entity> | R<length>:<id> | C
+// Entities use the negotiated wire format, so the buffer is not null-terminated and may contain
+// zero bytes.
+std::string encodeWriteBatch(const std::vector<PendingWrite>& writes);
+
+}  // namespace internal
+
 class Handle {
 public:
   virtual ~Handle() {}
@@ -266,27 +733,120 @@ public:
   // This should not be used directly by Particle implementations, and is virtual for testing.
   virtual void dereference(const std::string& ref_id, internal::DerefContinuation fn);
 
+  // Particle constructors may call this to have the handle reuse its existing storage when it is
+  // re-synced: entities are reset and decoded in place, and their text fields keep their string
+  // buffers, rather than everything being freed and reallocated one allocation at a time. This
+  // reduces heap churn and fragmentation for large, frequently synced handles, at the cost of
+  // holding on to the memory used by the largest sync seen so far.
+  void recycleOnSync(bool enable = true) { recycle_ = enable; }
+
+  // Particle constructors may call this to have writes that would not change the handle's data
+  // dropped before they reach the host, for particles that rewrite recomputed state whether or not
+  // it has changed. A write is redundant if the handle already holds an entity with the same id
+  // and fields; a Singleton also treats a new entity (with no id) that matches the current value
+  // as redundant, and gives it the current value's id. Readable handles compare against their
+  // local data. Write-only handles compare against the particle's own previous writes, so they
+  // should only use this if the particle is the only writer; Collections keep just a hash of each
+  // entity written, so there is a very small chance of a changed entity being treated as
+  // redundant.
+  void elideRedundantWrites(bool enable = true) { elide_ = enable; }
+
+  // Returns the number of writes dropped by elideRedundantWrites().
+  size_t elidedWrites() const { return elided_writes_; }
+
+  // Defers writes to this handle until the returned WriteBatch goes out of scope, then sends them
+  // to the host together. Writes to the same entity are coalesced so only the last one is sent,
+  // and a clear() drops everything written before it. The handle's local contents and update
+  // listeners still see each write immediately. Batches may be nested; writes are sent when the
+  // outermost one ends. For example:
+  //
+  //   {
+  //     auto batch = results_.batch();
+  //     for (Result& r : computed) results_.store(&r);
+  //   }
+  //
+  WriteBatch batch();
+
 protected:
   bool failForDirection(Direction bad_dir) const;
 
+  bool batching() const { return batch_depth_ > 0; }
+
+  // Creates an id for a new entity written to this handle. Ids are a host-provided prefix followed
+  // by a counter, so the host is only called when a lease of kIdLeaseSize ids runs out. Returns an
+  // empty id, leaving the host to assign one, if the lease fails.
+  std::string newId();
+
+  // Sends any writes deferred by a WriteBatch to the host.
+  virtual void flushBatch() {}
+
   // These are initialized by the Particle class.
   std::string name_;
   Particle* particle_;
   Direction dir_ = Unconnected;
+  bool recycle_ = false;
+  bool elide_ = false;
+  size_t elided_writes_ = 0;
+  int batch_depth_ = 0;
+
+  static constexpr uint32_t kIdLeaseSize = 1 << 16;
+  std::string id_prefix_;
+  uint32_t next_id_ = 0;
+  uint32_t ids_left_ = 0;
 
   friend class Particle;
+  friend class WriteBatch;
+};
+
+// Scope guard returned by Handle::batch().
+class WriteBatch {
+public:
+  WriteBatch(const WriteBatch&) = delete;
+  WriteBatch& operator=(const WriteBatch&) = delete;
+
+  ~WriteBatch() {
+    if (--handle_->batch_depth_ == 0) {
+      handle_->flushBatch();
+    }
+  }
+
+private:
+  explicit WriteBatch(Handle* handle) : handle_(handle) { handle_->batch_depth_++; }
+
+  Handle* handle_;
+
+  friend class Handle;
 };
 
+inline WriteBatch Handle::batch() {
+  return WriteBatch(this);
+}
+
 template<typename T>
 class Singleton : public Handle {
 public:
   void sync(const char* model) override {
     failForDirection(Out);
-    entity_ = T(this);
+    if (recycle_) {
+      internal::Accessor::reset_entity(&entity_);
+    } else {
+      entity_ = T(this);
+    }
     internal::Accessor::decode_entity(&entity_, model);
   }
 
+  // The host sends a patch (see Accessor::diff_entity) when only some fields of the current
+  // entity have changed; these are applied in place.
   void update(const char* model, const char* ignored) override {
+    if constexpr (!internal::IsRef<T>::value) {
+      if (internal::Accessor::is_patch(model)) {
+        failForDirection(Out);
+        if (!internal::Accessor::apply_patch(&entity_, model)) {
+          error("Singleton '%s' received a patch for a different entity\n", name_.c_str());
+        }
+        return;
+      }
+    }
     sync(model);
   }
 
@@ -299,297 +859,2004 @@ public:
   // the given entity with it. The data fields will not be modified.
   void set(T* entity) {
     failForDirection(In);
-    std::string encoded = internal::Accessor::encode_entity(*entity);
-    const char* id = internal::singletonSet(particle_, this, encoded.c_str());
-    if (id != nullptr) {
-      entity->_internal_id_ = id;
-      free((void*)id);
+    if (elide_ && !entity_._internal_id_.empty() &&
+        (entity->_internal_id_.empty() || entity->_internal_id_ == entity_._internal_id_) &&
+        internal::Accessor::fields_equal(*entity, entity_)) {
+      entity->_internal_id_ = entity_._internal_id_;
+      elided_writes_++;
+      return;
     }
-    // Write-only handles do not keep entity data locally.
-    if (dir_ == InOut) {
+    if (entity->_internal_id_.empty()) {
+      entity->_internal_id_ = newId();
+    }
+    // Changes to the current entity are sent as a patch with just the modified fields. This relies
+    // on the host holding entity_, which is not the case while an earlier write is still pending.
+    auto kind = internal::PendingWrite::kStore;
+    std::string encoded;
+    if constexpr (!internal::IsRef<T>::value) {
+      if ((dir_ == InOut || elide_) && pending_.kind == internal::PendingWrite::kNone &&
+          !entity_._internal_id_.empty() && entity->_internal_id_ == entity_._internal_id_) {
+        kind = internal::PendingWrite::kPatch;
+        encoded = internal::Accessor::diff_entity(entity_, *entity, internal::wireFormat());
+      }
+    }
+    if (kind == internal::PendingWrite::kStore) {
+      encoded = internal::Accessor::encode_entity(*entity, internal::wireFormat());
+    }
+    // Each write replaces the whole value, so a batch only needs to keep the last one. Entities
+    // left without an id by a failed lease are sent straight away, since the host creates the id.
+    if (batching() && !entity->_internal_id_.empty()) {
+      pending_ = {kind, std::move(encoded)};
+    } else if (kind == internal::PendingWrite::kPatch) {
+      internal::singletonPatch(particle_, this, encoded.c_str());
+    } else {
+      pending_ = {internal::PendingWrite::kNone, {}};
+      const char* id = internal::singletonSet(particle_, this, encoded.c_str());
+      if (id != nullptr) {
+        entity->_internal_id_ = id;
+        free((void*)id);
+      }
+    }
+    // Write-only handles only keep entity data locally for elideRedundantWrites().
+    if (dir_ == InOut || elide_) {
       entity_ = *entity;
     }
   }
 
   void clear() {
     failForDirection(In);
-    internal::singletonClear(particle_, this);
-    if (dir_ == InOut) {
+    if (batching()) {
+      pending_ = {internal::PendingWrite::kClear, {}};
+    } else {
+      internal::singletonClear(particle_, this);
+    }
+    if (dir_ == InOut || elide_) {
       entity_ = T();
     }
   }
 
 private:
+  // Deferred entities always have ids, so the host doesn't return one.
+  void flushBatch() override {
+    if (pending_.kind == internal::PendingWrite::kStore) {
+      free((void*)internal::singletonSet(particle_, this, pending_.encoded.c_str()));
+    } else if (pending_.kind == internal::PendingWrite::kPatch) {
+      internal::singletonPatch(particle_, this, pending_.encoded.c_str());
+    } else if (pending_.kind == internal::PendingWrite::kClear) {
+      internal::singletonClear(particle_, this);
+    }
+    pending_ = {internal::PendingWrite::kNone, {}};
+  }
+
   T entity_;
+  internal::PendingWrite pending_ = {internal::PendingWrite::kNone, {}};
 };
 
-// Minimal iterator for Collections; allows iterating directly over const T& values.
-template<typename T>
-class WrappedIter {
-  using Iterator = typename std::unordered_map<std::string, std::unique_ptr<T>>::const_iterator;
+namespace internal {
 
+// Open-addressing hash index from entity ids to slots in a Collection's dense entity vector.
+// Interned id handles are used directly as hashes; they are allocated densely, so masking them
+// spreads entries evenly across buckets.
+// Buckets store the id hash so the table can be grown without access to the entities; lookups
+// confirm a match by comparing the id at the candidate slot. Uses linear probing with
+// backward-shift deletion, so removals leave no tombstones behind.
+class SlotIndex {
 public:
-  WrappedIter(Iterator it) : it_(std::move(it)) {}
+  static constexpr uint32_t kNone = ~uint32_t(0);
+
+  // Returns the slot for which match(slot) is true, or kNone.
+  template<typename Match>
+  uint32_t find(uint32_t hash, Match&& match) const {
+    if (buckets_.empty()) {
+      return kNone;
+    }
+    size_t mask = buckets_.size() - 1;
+    for (size_t i = hash & mask; buckets_[i].slot != kNone; i = (i + 1) & mask) {
+      if (buckets_[i].hash == hash && match(buckets_[i].slot)) {
+        return buckets_[i].slot;
+      }
+    }
+    return kNone;
+  }
 
-  const T& operator*() const { return *it_->second; }
-  const T* operator->() const { return it_->second.get(); }
+  // The caller must ensure the id isn't already present.
+  void insert(uint32_t hash, uint32_t slot);
 
-  WrappedIter& operator++() { ++it_; return *this; }
-  WrappedIter operator++(int) { return WrappedIter(it_++); }
+  // Removes the entry for the given slot.
+  void erase(uint32_t hash, uint32_t slot);
 
-  friend bool operator==(const WrappedIter& a, const WrappedIter& b) { return a.it_ == b.it_; }
-  friend bool operator!=(const WrappedIter& a, const WrappedIter& b) { return a.it_ != b.it_; }
+  // Updates the entry for an entity moved from one slot to another.
+  void move(uint32_t hash, uint32_t from, uint32_t to);
+
+  void clear();
 
 private:
-  Iterator it_;
-};
+  struct Bucket {
+    uint32_t hash;
+    uint32_t slot;
+  };
 
-template<typename T>
-class Collection : public Handle {
-  using Map = std::unordered_map<std::string, std::unique_ptr<T>>;
+  size_t position(uint32_t hash, uint32_t slot) const;
+  void grow();
+
+  std::vector<Bucket> buckets_;
+  size_t size_ = 0;
+};
 
+// Growable bitmap packed into 32-bit words. Bits past size() are always zero, so whole words can
+// be scanned without masking the tail.
+class Bitmap {
 public:
-  void sync(const char* model) override {
-    entities_.clear();
-    add(model);
-  }
+  size_t size() const { return size_; }
+  bool test(size_t i) const { return (words_[i / 32] >> (i % 32)) & 1; }
 
-  void update(const char* added, const char* removed) override {
-    add(added);
-    internal::StringDecoder::decodeList(removed, [this](const std::string& str) {
-      std::string id;
-      internal::StringDecoder(str.c_str()).decode(id);
-      entities_.erase(id);
-    });
+  void assign(size_t i, bool value) {
+    uint32_t bit = uint32_t(1) << (i % 32);
+    words_[i / 32] = value ? (words_[i / 32] | bit) : (words_[i / 32] & ~bit);
   }
 
-  bool empty() const {
-    failForDirection(Out);
-    return entities_.empty();
-  }
+  void resize(size_t size);
 
-  size_t size() const {
-    failForDirection(Out);
-    return entities_.size();
-  }
+  // Overwrites bits [32 * i, 32 * i + 32); any bits past size() must be zero.
+  void set_word(size_t i, uint32_t bits) { words_[i] = bits; }
 
-  WrappedIter<T> begin() const {
-    failForDirection(Out);
-    return WrappedIter<T>(entities_.cbegin());
+  // Returns the number of set bits.
+  size_t count() const;
+
+  const std::vector<uint32_t>& words() const { return words_; }
+
+private:
+  std::vector<uint32_t> words_;
+  size_t size_ = 0;
+};
+
+}  // namespace internal
+
+// A single field of a Columns view: a contiguous array of values with a parallel validity bitmap.
+// Rows for which the field is not set hold the type's default value (0 or false). Boolean values
+// are stored one per byte so they can be scanned directly.
+template<typename V>
+class Column {
+public:
+  using Storage = std::conditional_t<std::is_same<V, bool>::value, uint8_t, V>;
+
+  size_t size() const { return values_.size(); }
+  V operator[](size_t row) const { return values_[row]; }
+  bool has(size_t row) const { return valid_.test(row); }
+
+  const Storage* data() const { return values_.data(); }
+  const std::vector<Storage>& values() const { return values_; }
+  const internal::Bitmap& valid() const { return valid_; }
+
+private:
+  void resize(size_t size) {
+    values_.resize(size);
+    valid_.resize(size);
   }
 
-  WrappedIter<T> end() const {
-    failForDirection(Out);
-    return WrappedIter<T>(entities_.cend());
+  void assign(size_t row, V value, bool valid) {
+    values_[row] = value;
+    valid_.assign(row, valid);
   }
 
-  // For new entities created by a particle, this method will generate a new internal ID and update
-  // the given entity with it. The data fields will not be modified.
-  void store(T* entity) {
-    failForDirection(In);
-    std::string encoded = internal::Accessor::encode_entity(*entity);
-    const char* id = internal::collectionStore(particle_, this, encoded.c_str());
-    if (id != nullptr) {
-      entity->_internal_id_ = id;
-      free((void*)id);
-    }
-    // Write-only handles do not keep entity data locally.
-    if (dir_ == InOut) {
-      entities_.emplace(entity->_internal_id_, new T(*entity));
+  // Mirrors Collection's removal: moves the last row into the given one.
+  void swap_remove(size_t row) {
+    size_t last = values_.size() - 1;
+    if (row != last) {
+      assign(row, values_[last], valid_.test(last));
     }
+    resize(last);
   }
 
-  void remove(const T& entity) {
-    failForDirection(In);
-    std::string encoded = internal::Accessor::encode_entity(entity);
-    internal::collectionRemove(particle_, this, encoded.c_str());
+  std::vector<Storage> values_;
+  internal::Bitmap valid_;
+
+  template<typename T> friend class Columns;
+};
+
+// Columnar view over a Collection; see Collection::columns(). Generated entity classes specialize
+// this with a Column for each Number and Boolean field. The primary template has no columns.
+template<typename T>
+class Columns {
+public:
+  size_t size() const { return size_; }
+
+private:
+  void resize(size_t size) { size_ = size; }
+  void assign(size_t row, const T& entity) {}
+  void swap_remove(size_t row) { size_--; }
+
+  size_t size_ = 0;
+
+  friend class Collection<T>;
+};
+
+// The changes made to a Collection by a single update; see Collection::onUpdate(). The added and
+// changed pointers refer to entities in the collection and are only valid for the duration of
+// the listener call. Removed entities are no longer in the collection, so they are held here.
+template<typename T>
+struct CollectionDelta {
+  std::vector<const T*> added;
+  std::vector<const T*> changed;
+  std::vector<T> removed;
+
+  bool empty() const { return added.empty() && changed.empty() && removed.empty(); }
+};
+
+// Minimal iterator for Collections; allows iterating directly over const T& values.
+template<typename T>
+class WrappedIter {
+  using Iterator = typename std::vector<T>::const_iterator;
+
+public:
+  WrappedIter(Iterator it) : it_(std::move(it)) {}
+
+  const T& operator*() const { return *it_; }
+  const T* operator->() const { return &*it_; }
+
+  WrappedIter& operator++() { ++it_; return *this; }
+  WrappedIter operator++(int) { return WrappedIter(it_++); }
+
+  friend bool operator==(const WrappedIter& a, const WrappedIter& b) { return a.it_ == b.it_; }
+  friend bool operator!=(const WrappedIter& a, const WrappedIter& b) { return a.it_ != b.it_; }
+
+private:
+  Iterator it_;
+};
+
+namespace internal {
+
+// Type of a generated entity class's accessor method for a field of type K; Number and Boolean
+// fields are returned by value, others by const reference.
+template<typename T, typename K>
+using FieldGetter = std::conditional_t<std::is_arithmetic<K>::value, K, const K&> (T::*)() const;
+
+// Base for the secondary indexes that can be added to a Collection. Indexes refer to entities by
+// their slot in the Collection's entity vector, and are updated by the Collection as entities are
+// added, removed or moved between slots.
+template<typename T>
+class CollectionIndex {
+public:
+  virtual ~CollectionIndex() {}
+
+protected:
+  explicit CollectionIndex(const std::vector<T>* entities) : entities_(entities) {}
+
+  virtual void insert(uint32_t slot, const T& entity) = 0;
+  virtual void erase(uint32_t slot, const T& entity) = 0;
+  virtual void clear() = 0;
+
+  const std::vector<T>* entities_;
+
+  friend class Collection<T>;
+};
+
+}  // namespace internal
+
+// Hash index on an entity field, created with Collection::addHashIndex(). Entities without the
+// field set are not indexed. Pointers returned by lookups are invalidated by any subsequent change
+// to the collection.
+template<typename T, typename K>
+class HashIndex : public internal::CollectionIndex<T> {
+public:
+  using Getter = internal::FieldGetter<T, K>;
+  using Has = bool (T::*)() const;
+
+  // Returns the entities with the given field value.
+  std::vector<const T*> find(const K& key) const {
+    std::vector<const T*> res;
+    auto it = slots_.find(key);
+    if (it != slots_.end()) {
+      for (uint32_t slot : it->second) {
+        res.push_back(&(*this->entities_)[slot]);
+      }
+    }
+    return res;
+  }
+
+  size_t count(const K& key) const {
+    auto it = slots_.find(key);
+    return (it != slots_.end()) ? it->second.size() : 0;
+  }
+
+private:
+  HashIndex(const std::vector<T>* entities, Getter getter, Has has)
+      : internal::CollectionIndex<T>(entities), getter_(getter), has_(has) {}
+
+  void insert(uint32_t slot, const T& entity) override {
+    if ((entity.*has_)()) {
+      slots_[(entity.*getter_)()].push_back(slot);
+    }
+  }
+
+  void erase(uint32_t slot, const T& entity) override {
+    if (!(entity.*has_)()) {
+      return;
+    }
+    auto it = slots_.find((entity.*getter_)());
+    if (it == slots_.end()) {
+      return;
+    }
+    std::vector<uint32_t>& slots = it->second;
+    for (size_t i = 0; i < slots.size(); i++) {
+      if (slots[i] == slot) {
+        slots[i] = slots.back();
+        slots.pop_back();
+        break;
+      }
+    }
+    if (slots.empty()) {
+      slots_.erase(it);
+    }
+  }
+
+  void clear() override {
+    slots_.clear();
+  }
+
+  Getter getter_;
+  Has has_;
+  std::unordered_map<K, std::vector<uint32_t>> slots_;
+
+  friend class Collection<T>;
+};
+
+// Ordered index on an entity field, created with Collection::addOrderedIndex(), for range queries
+// and top-k lookups. Entities without the field set are not indexed. Pointers returned by lookups
+// are invalidated by any subsequent change to the collection.
+template<typename T, typename K>
+class OrderedIndex : public internal::CollectionIndex<T> {
+  using Entry = std::pair<K, uint32_t>;
+
+public:
+  using Getter = internal::FieldGetter<T, K>;
+  using Has = bool (T::*)() const;
+
+  size_t size() const { return entries_.size(); }
+
+  // Returns the entities with lo <= value < hi, in ascending order of value.
+  std::vector<const T*> range(const K& lo, const K& hi) const {
+    std::vector<const T*> res;
+    auto end = entries_.lower_bound(Entry(hi, 0));
+    for (auto it = entries_.lower_bound(Entry(lo, 0)); it != end; ++it) {
+      res.push_back(&(*this->entities_)[it->second]);
+    }
+    return res;
+  }
+
+  // Returns the k entities with the largest values, in descending order.
+  std::vector<const T*> top(size_t k) const {
+    std::vector<const T*> res;
+    for (auto it = entries_.rbegin(); it != entries_.rend() && res.size() < k; ++it) {
+      res.push_back(&(*this->entities_)[it->second]);
+    }
+    return res;
+  }
+
+  // Returns the k entities with the smallest values, in ascending order.
+  std::vector<const T*> bottom(size_t k) const {
+    std::vector<const T*> res;
+    for (auto it = entries_.begin(); it != entries_.end() && res.size() < k; ++it) {
+      res.push_back(&(*this->entities_)[it->second]);
+    }
+    return res;
+  }
+
+private:
+  OrderedIndex(const std::vector<T>* entities, Getter getter, Has has)
+      : internal::CollectionIndex<T>(entities), getter_(getter), has_(has) {}
+
+  void insert(uint32_t slot, const T& entity) override {
+    if ((entity.*has_)()) {
+      entries_.emplace((entity.*getter_)(), slot);
+    }
+  }
+
+  void erase(uint32_t slot, const T& entity) override {
+    if ((entity.*has_)()) {
+      entries_.erase(Entry((entity.*getter_)(), slot));
+    }
+  }
+
+  void clear() override {
+    entries_.clear();
+  }
+
+  Getter getter_;
+  Has has_;
+  std::set<Entry> entries_;
+
+  friend class Collection<T>;
+};
+
+// Entities are held contiguously in a vector, indexed by id via an internal::SlotIndex. Removal
+// moves the last entity into the vacated slot, so iteration order is unspecified, and references
+// obtained while iterating are invalidated by any subsequent change to the collection.
+template<typename T>
+class Collection : public Handle {
+public:
+  using value_type = T;
+
+  void sync(const char* model) override {
+    if (recycle_) {
+      resync(model);
+    } else {
+      clearLocal();
+      add(model);
+    }
+    // Syncs aren't reported to the update listeners.
+    added_ids_.clear();
+    changed_ids_.clear();
+    for (const auto& listener : sync_listeners_) {
+      listener();
+    }
+  }
+
+  void update(const char* added, const char* removed) override {
+    add(added);
+    if (internal::BinaryDecoder::matches(removed)) {
+      internal::BinaryDecoder::decodeList(removed, [this](internal::BinaryDecoder& decoder) {
+        internal::Id id;
+        decoder.decode(id);
+        erase(id);
+      });
+    } else {
+      internal::StringDecoder::decodeList(removed, [this](std::string_view chunk) {
+        internal::Id id;
+        internal::StringDecoder(chunk).decode(id);
+        erase(id);
+      });
+    }
+    notifyListeners();
+  }
+
+  // Registers a listener to be called with the entities added, changed and removed by each update
+  // to the collection, including the particle's own store(), remove() and clear() calls. This is
+  // called before Particle::onHandleUpdate(), allowing particles to maintain incremental state
+  // rather than rescanning the collection. Overwrites that leave an entity's fields unchanged (such
+  // as the runtime echoing back the particle's own writes) are not reported. Syncs replace the
+  // whole collection and are reported via Particle::onHandleSync() instead. Listeners must not
+  // modify the collection.
+  void onUpdate(std::function<void(const CollectionDelta<T>&)> listener) {
+    failForDirection(Out);
+    listeners_.push_back(std::move(listener));
+  }
+
+  // Registers a listener to be called after each sync, once the collection holds its new contents.
+  void onSync(std::function<void()> listener) {
+    failForDirection(Out);
+    sync_listeners_.push_back(std::move(listener));
+  }
+
+  bool empty() const {
+    failForDirection(Out);
+    return entities_.empty();
+  }
+
+  size_t size() const {
+    failForDirection(Out);
+    return entities_.size();
+  }
+
+  WrappedIter<T> begin() const {
+    failForDirection(Out);
+    return WrappedIter<T>(entities_.cbegin());
+  }
+
+  WrappedIter<T> end() const {
+    failForDirection(Out);
+    return WrappedIter<T>(entities_.cend());
+  }
+
+  // Returns the entity with the given id, or nullptr if there isn't one. The pointer is
+  // invalidated by any subsequent change to the collection.
+  const T* find(const std::string& id) const {
+    failForDirection(Out);
+    internal::Id key;
+    return internal::Id::lookup(id, &key) ? get(key) : nullptr;
+  }
+
+  bool contains(const std::string& id) const {
+    return find(id) != nullptr;
+  }
+
+  // Adds a secondary index on the field with the given accessor methods, for example:
+  //   const auto& by_name = collection.addHashIndex(&Person::name, &Person::has_name);
+  //   for (const Person* p : by_name.find("Ann")) ...
+  // Indexes are built from the current contents and then maintained as the collection changes.
+  // The returned reference stays valid for the lifetime of the collection.
+  template<typename K>
+  const HashIndex<T, std::decay_t<K>>& addHashIndex(K (T::*getter)() const, bool (T::*has)() const) {
+    failForDirection(Out);
+    return addIndex(new HashIndex<T, std::decay_t<K>>(&entities_, getter, has));
+  }
+
+  // As above, for an ordered index supporting range and top-k queries.
+  template<typename K>
+  const OrderedIndex<T, std::decay_t<K>>& addOrderedIndex(K (T::*getter)() const,
+                                                          bool (T::*has)() const) {
+    failForDirection(Out);
+    return addIndex(new OrderedIndex<T, std::decay_t<K>>(&entities_, getter, has));
+  }
+
+  // Returns a columnar view of the entities' Number and Boolean fields, for particles that scan a
+  // few fields across large collections. Row i corresponds to the i'th entity in iteration order.
+  // The view is built on the first call and then kept in sync as the collection changes, so
+  // handles that never call this pay nothing for it.
+  const Columns<T>& columns() {
+    failForDirection(Out);
+    if (!columns_) {
+      columns_.reset(new Columns<T>());
+      refreshColumns();
+    }
+    return *columns_;
+  }
+
+  // For new entities created by a particle, this method will generate a new internal ID and update
+  // the given entity with it. The data fields will not be modified.
+  void store(T* entity) {
+    failForDirection(In);
+    // Write-only handles do not keep entity data locally.
+    if (sendStore(entity) && dir_ == InOut) {
+      insert(T(*entity));
+      notifyListeners();
+    }
+  }
+
+  // As above, but moves the entity into the collection rather than copying it.
+  void store(T&& entity) {
+    failForDirection(In);
+    if (sendStore(&entity) && dir_ == InOut) {
+      insert(std::move(entity));
+      notifyListeners();
+    }
+  }
+
+  // Moves the given entities into the collection. They are sent to the host as a single batch,
+  // and reported to update listeners as a single delta.
+  void storeAll(std::vector<T>&& entities) {
+    failForDirection(In);
+    WriteBatch scope = batch();
+    for (T& entity : entities) {
+      if (sendStore(&entity) && dir_ == InOut) {
+        insert(std::move(entity));
+      }
+    }
+    entities.clear();
+    if (dir_ == InOut) {
+      notifyListeners();
+    }
+  }
+
+  void remove(const T& entity) {
+    failForDirection(In);
+    sendRemove(entity._internal_id_);
+    if (dir_ == InOut) {
+      erase(entity._internal_id_);
+      notifyListeners();
+    }
+  }
+
+  // Removes the entity with the given id. Only the id is sent to the host.
+  void remove(const std::string& id) {
+    failForDirection(In);
+    internal::Id key;
+    bool known = internal::Id::lookup(id, &key);
+    sendRemove(key, id);
+    if (known && dir_ == InOut) {
+      erase(key);
+      notifyListeners();
+    }
+  }
+
+  // Removes the entities with the given ids as a single batch and update.
+  void removeIds(const std::vector<std::string>& ids) {
+    failForDirection(In);
+    WriteBatch scope = batch();
+    for (const std::string& id : ids) {
+      internal::Id key;
+      bool known = internal::Id::lookup(id, &key);
+      sendRemove(key, id);
+      if (known && dir_ == InOut) {
+        erase(key);
+      }
+    }
+    if (dir_ == InOut) {
+      notifyListeners();
+    }
+  }
+
+  // Replaces the contents of the collection with the given entities, as a single batch and update.
+  // For readable handles only the difference from the current contents is sent and reported:
+  // entities that are missing from the new contents are removed, and those with the same id and
+  // fields as an existing entity are left alone. Write-only handles send a clear followed by the
+  // new contents.
+  void replaceAll(std::vector<T>&& entities) {
+    failForDirection(In);
+    WriteBatch scope = batch();
+    if (dir_ != InOut) {
+      sendClear();
+      for (T& entity : entities) {
+        sendStore(&entity);
+      }
+      entities.clear();
+      return;
+    }
+    std::unordered_set<internal::Id> keep;
+    for (T& entity : entities) {
+      if (entity._internal_id_.empty()) {
+        entity._internal_id_ = newId();
+      }
+      keep.insert(entity._internal_id_);
+    }
+    std::vector<internal::Id> stale;
+    for (const T& entity : entities_) {
+      if (keep.count(entity._internal_id_) == 0) {
+        stale.push_back(entity._internal_id_);
+      }
+    }
+    for (const internal::Id& id : stale) {
+      sendRemove(id);
+      erase(id);
+    }
+    for (T& entity : entities) {
+      const T* existing = get(entity._internal_id_);
+      if (existing == nullptr || !internal::Accessor::fields_equal(*existing, entity)) {
+        sendStore(&entity);
+        insert(std::move(entity));
+      }
+    }
+    entities.clear();
+    notifyListeners();
+  }
+
+  void clear() {
+    failForDirection(In);
+    sendClear();
     if (dir_ == InOut) {
-      entities_.erase(entity._internal_id_);
+      if (!listeners_.empty()) {
+        for (T& entity : entities_) {
+          delta_.removed.push_back(std::move(entity));
+        }
+      }
+      clearLocal();
+      notifyListeners();
+    }
+  }
+
+private:
+  // Sends a write to the host, or adds it to the current batch. New entities are given an id.
+  // Returns false if the write was elided.
+  bool sendStore(T* entity) {
+    if (entity->_internal_id_.empty()) {
+      entity->_internal_id_ = newId();
+    } else if (elide_ && isRedundant(*entity)) {
+      elided_writes_++;
+      return false;
+    }
+    std::string encoded = internal::Accessor::encode_entity(*entity, internal::wireFormat());
+    if (entity->_internal_id_.empty()) {
+      // The id lease failed, so the entity is sent straight away for the host to create its id,
+      // after any deferred writes to keep the host's view of the writes in order.
+      flushBatch();
+      const char* id = internal::collectionStore(particle_, this, encoded.c_str());
+      if (id != nullptr) {
+        entity->_internal_id_ = id;
+        free((void*)id);
+      }
+    } else if (batching()) {
+      deferWrite(internal::PendingWrite::kStore, entity->_internal_id_, std::move(encoded));
+    } else {
+      free((void*)internal::collectionStore(particle_, this, encoded.c_str()));
+    }
+    if (elide_ && dir_ != InOut && !entity->_internal_id_.empty()) {
+      written_[entity->_internal_id_] = internal::Accessor::hash_entity(*entity);
+    }
+    return true;
+  }
+
+  bool isRedundant(const T& entity) const {
+    if (dir_ == InOut) {
+      const T* existing = get(entity._internal_id_);
+      return existing != nullptr && internal::Accessor::fields_equal(*existing, entity);
+    }
+    auto it = written_.find(entity._internal_id_);
+    return it != written_.end() && it->second == internal::Accessor::hash_entity(entity);
+  }
+
+  // Removals only need the entity's id.
+  void sendRemove(const internal::Id& id) { sendRemove(id, id.str()); }
+
+  // Ids that were never interned are passed as an empty Id, since no entity or write can have them.
+  void sendRemove(const internal::Id& id, const std::string& str) {
+    written_.erase(id);
+    if (batching()) {
+      deferWrite(internal::PendingWrite::kRemove, id, str);
+    } else {
+      internal::collectionRemoveById(particle_, this, str.c_str());
+    }
+  }
+
+  void sendClear() {
+    written_.clear();
+    if (batching()) {
+      pending_.clear();
+      pending_ids_.clear();
+      pending_.push_back({internal::PendingWrite::kClear, {}});
+    } else {
+      internal::collectionClear(particle_, this);
+    }
+  }
+
+  // Queues a write for the current batch, replacing any earlier write to the same entity.
+  void deferWrite(internal::PendingWrite::Kind kind, const internal::Id& id, std::string encoded) {
+    auto it = pending_ids_.find(id);
+    if (it != pending_ids_.end()) {
+      pending_[it->second] = {internal::PendingWrite::kNone, {}};
+      pending_ids_.erase(it);
+    }
+    // Nothing stored before a clear survives it, so removals after one have nothing to do.
+    if (kind == internal::PendingWrite::kRemove && !pending_.empty() &&
+        pending_.front().kind == internal::PendingWrite::kClear) {
+      return;
+    }
+    if (!id.empty()) {
+      pending_ids_.emplace(id, pending_.size());
+    }
+    pending_.push_back({kind, std::move(encoded)});
+  }
+
+  void flushBatch() override {
+    if (pending_.empty()) {
+      return;
+    }
+    std::string encoded = internal::encodeWriteBatch(pending_);
+    pending_.clear();
+    pending_ids_.clear();
+    internal::collectionApplyBatch(particle_, this, encoded.data(), encoded.size());
+  }
+
+  void add(const char* added) {
+    failForDirection(Out);
+    if (internal::BinaryDecoder::matches(added)) {
+      internal::BinaryDecoder::decodeList(added, [this](internal::BinaryDecoder& decoder) {
+        T entity(this);
+        internal::Accessor::decode_entity(&entity, decoder);
+        insert(std::move(entity));
+      });
+    } else {
+      internal::StringDecoder::decodeList(added, [this](std::string_view chunk) {
+        T entity(this);
+        internal::StringDecoder decoder(chunk);
+        internal::Accessor::decode_entity(&entity, decoder);
+        insert(std::move(entity));
+      });
+    }
+  }
+
+  // Decodes the model into the existing entity slots, only growing the vector when needed.
+  void resync(const char* model) {
+    failForDirection(Out);
+    index_.clear();
+    size_t count = 0;
+    auto decode = [this, &count](auto& decoder) {
+      if (count == entities_.size()) {
+        entities_.push_back(T(this));
+      }
+      T& entity = entities_[count];
+      internal::Accessor::reset_entity(&entity);
+      internal::Accessor::decode_entity(&entity, decoder);
+      uint32_t slot = locate(entity._internal_id_);
+      if (slot != internal::SlotIndex::kNone) {
+        entities_[slot] = std::move(entity);
+      } else {
+        index_.insert(entity._internal_id_.hash(), count++);
+      }
+    };
+    if (internal::BinaryDecoder::matches(model)) {
+      internal::BinaryDecoder::decodeList(model, decode);
+    } else {
+      internal::StringDecoder::decodeList(model, [&decode](std::string_view chunk) {
+        internal::StringDecoder decoder(chunk);
+        decode(decoder);
+      });
+    }
+    entities_.erase(entities_.begin() + count, entities_.end());
+    refreshIndexes();
+    refreshColumns();
+  }
+
+  // Resolves the ids recorded by insert() now that the update is complete (removals may have moved
+  // entities between slots) and passes the delta to the listeners.
+  void notifyListeners() {
+    if (listeners_.empty()) {
+      return;
+    }
+    auto resolve = [this](std::vector<internal::Id>* ids, std::vector<const T*>* res) {
+      for (const internal::Id& id : *ids) {
+        uint32_t slot = locate(id);
+        if (slot != internal::SlotIndex::kNone) {
+          res->push_back(&entities_[slot]);
+        }
+      }
+      ids->clear();
+    };
+    resolve(&added_ids_, &delta_.added);
+    resolve(&changed_ids_, &delta_.changed);
+    if (!delta_.empty()) {
+      for (const auto& listener : listeners_) {
+        listener(delta_);
+      }
+    }
+    // Clearing keeps the vectors' capacity for the next update.
+    delta_.added.clear();
+    delta_.changed.clear();
+    delta_.removed.clear();
+  }
+
+  template<typename I>
+  const I& addIndex(I* index) {
+    indexes_.emplace_back(index);
+    for (size_t slot = 0; slot < entities_.size(); slot++) {
+      index->insert(slot, entities_[slot]);
+    }
+    return *index;
+  }
+
+  void refreshIndexes() {
+    for (auto& index : indexes_) {
+      index->clear();
+      for (size_t slot = 0; slot < entities_.size(); slot++) {
+        index->insert(slot, entities_[slot]);
+      }
+    }
+  }
+
+  void refreshColumns() {
+    if (columns_) {
+      columns_->resize(entities_.size());
+      for (size_t row = 0; row < entities_.size(); row++) {
+        columns_->assign(row, entities_[row]);
+      }
+    }
+  }
+
+  const T* get(const internal::Id& id) const {
+    uint32_t slot = locate(id);
+    return (slot != internal::SlotIndex::kNone) ? &entities_[slot] : nullptr;
+  }
+
+  uint32_t locate(const internal::Id& id) const {
+    return index_.find(id.hash(), [this, &id](uint32_t slot) {
+      return entities_[slot]._internal_id_ == id;
+    });
+  }
+
+  // Adds the entity, replacing any existing entity with the same id.
+  void insert(T&& entity) {
+    uint32_t hash = entity._internal_id_.hash();
+    uint32_t slot = locate(entity._internal_id_);
+    if (slot != internal::SlotIndex::kNone) {
+      if (!listeners_.empty() && !internal::Accessor::fields_equal(entities_[slot], entity)) {
+        changed_ids_.push_back(entity._internal_id_);
+      }
+      for (auto& index : indexes_) {
+        index->erase(slot, entities_[slot]);
+      }
+      entities_[slot] = std::move(entity);
+    } else {
+      if (!listeners_.empty()) {
+        added_ids_.push_back(entity._internal_id_);
+      }
+      slot = entities_.size();
+      index_.insert(hash, slot);
+      entities_.push_back(std::move(entity));
+      if (columns_) {
+        columns_->resize(entities_.size());
+      }
+    }
+    for (auto& index : indexes_) {
+      index->insert(slot, entities_[slot]);
+    }
+    if (columns_) {
+      columns_->assign(slot, entities_[slot]);
+    }
+  }
+
+  void erase(const internal::Id& id) {
+    uint32_t slot = locate(id);
+    if (slot == internal::SlotIndex::kNone) {
+      return;
+    }
+    index_.erase(id.hash(), slot);
+    for (auto& index : indexes_) {
+      index->erase(slot, entities_[slot]);
+    }
+    if (!listeners_.empty()) {
+      delta_.removed.push_back(std::move(entities_[slot]));
+    }
+    uint32_t last = entities_.size() - 1;
+    if (slot != last) {
+      for (auto& index : indexes_) {
+        index->erase(last, entities_[last]);
+      }
+      entities_[slot] = std::move(entities_[last]);
+      index_.move(entities_[slot]._internal_id_.hash(), last, slot);
+      for (auto& index : indexes_) {
+        index->insert(slot, entities_[slot]);
+      }
+    }
+    entities_.pop_back();
+    if (columns_) {
+      columns_->swap_remove(slot);
+    }
+  }
+
+  void clearLocal() {
+    entities_.clear();
+    index_.clear();
+    for (auto& index : indexes_) {
+      index->clear();
+    }
+    if (columns_) {
+      columns_->resize(0);
+    }
+  }
+
+  std::vector<T> entities_;
+  internal::SlotIndex index_;
+  std::vector<std::unique_ptr<internal::CollectionIndex<T>>> indexes_;
+  std::unique_ptr<Columns<T>> columns_;
+
+  // Update listeners and the pending delta for the current update. Changes are only recorded
+  // while there are listeners.
+  std::vector<std::function<void(const CollectionDelta<T>&)>> listeners_;
+  std::vector<std::function<void()>> sync_listeners_;
+  std::vector<internal::Id> added_ids_;
+  std::vector<internal::Id> changed_ids_;
+  CollectionDelta<T> delta_;
+
+  // Writes deferred by a WriteBatch, and the position of the latest write for each entity.
+  std::vector<internal::PendingWrite> pending_;
+  std::unordered_map<internal::Id, size_t> pending_ids_;
+
+  // Hashes of the entities written to a write-only handle, for elideRedundantWrites().
+  std::unordered_map<internal::Id, size_t> written_;
+
+  template<typename L, typename R, typename J> friend class Join;
+};
+
+// Arcs-style reference to an entity.
+template<typename T>
+class Ref {
+  struct Payload {
+    T entity;
+    bool dereferenced = false;
+  };
+
+public:
+  // References are copyable and share a pointer to the underlying entity data.
+  Ref(Handle* handle = nullptr) : handle_(handle), payload_(new Payload()) {}
+
+  // Retrieve the referenced entity data from the backing store. The first time this is called,
+  // the given continuation will be executed *asynchronously* - i.e. after the calling function has
+  // completed. Care should be taken with values being captured by a continuation lambda. Subsequent
+  // calls will immediately execute the continuation with the previously retrieved entity data.
+  // Example usage:
+  //
+  //   // Given the class field: arcs::Singleton<arcs::Ref<arcs::Data>> data_
+  //   void onHandleUpdate(const std::string& name) override {
+  //     if (name == "data") {
+  //       data_.get().dereference([this] {
+  //         do_something_with(data_.get().entity());
+  //       });
+  //     }
+  //   }
+  //
+  // This method needs to be const because the object is returned as const from handles, but it does
+  // modify the internal state of this object to update a local copy of the retrieved entity data.
+  void dereference(std::function<void()> continuation) const {
+    if (payload_->dereferenced) {
+      continuation();
+    } else if (handle_ != nullptr) {
+      // The handle simply bounces this to its owning particle, adding itself as a parameter.
+      handle_->dereference(_internal_id_, {payload_, &Ref::decode_payload, std::move(continuation)});
+    }
+  }
+
+  bool is_dereferenced() const {
+    return payload_->dereferenced;
+  }
+
+  // Returns the underlying entity data. If this object has not been dereferenced yet,
+  // this will be an empty instance of the entity type T.
+  const T& entity() const {
+    return payload_->entity;
+  }
+
+  // Unlike the generated entity classes, arcs::fields_equal and operator== are equivalent for Refs.
+  bool operator==(const Ref<T>& other) const {
+    return _internal_id_ == other._internal_id_ && storage_key_ == other.storage_key_;
+  }
+
+  bool operator!=(const Ref<T>& other) const {
+    return !(*this == other);
+  }
+
+  // For STL containers.
+  friend bool operator<(const Ref<T>& a, const Ref<T>& b) {
+    int cmp = a._internal_id_.compare(b._internal_id_);
+    return (cmp != 0) ? (cmp < 0) : (a.storage_key_.compare(b.storage_key_) < 0);
+  }
+
+private:
+  internal::Id _internal_id_;
+  internal::Id storage_key_;
+  Handle* handle_;
+  std::shared_ptr<Payload> payload_;
+
+  static void decode_payload(void* payload, const char* encoded) {
+    Payload* p = static_cast<Payload*>(payload);
+    internal::Accessor::decode_entity(&p->entity, encoded);
+    p->dereferenced = true;
+  }
+
+  friend class Singleton<Ref<T>>;
+  friend class Collection<Ref<T>>;
+  friend class internal::Accessor;
+};
+
+template<typename T>
+inline Ref<T> internal::Accessor::clone_entity(const Ref<T>& ref) {
+  return ref;
+}
+
+template<typename T>
+inline size_t internal::Accessor::hash_entity(const Ref<T>& ref) {
+  size_t h = 0;
+  internal::hash_combine(h, ref._internal_id_);
+  internal::hash_combine(h, ref.storage_key_);
+  return h;
+}
+
+template<typename T>
+inline bool internal::Accessor::fields_equal(const Ref<T>& a, const Ref<T>& b) {
+  return a == b;
+}
+
+template<typename T>
+inline std::string internal::Accessor::entity_to_str(const Ref<T>& ref, const char* unused) {
+  internal::StringPrinter printer;
+  printer.add("REF<", ref._internal_id_.str());
+  if (!ref.storage_key_.empty()) {
+    printer.add("|", ref.storage_key_.str());
+  }
+  if (ref.is_dereferenced()) {
+    printer.add("|", entity_to_str(ref.entity(), ", "));
+  }
+  printer.add(">");
+  return printer.result("");
+}
+
+template<typename T>
+inline void internal::Accessor::reset_entity(Ref<T>* ref) {
+  *ref = Ref<T>(ref->handle_);
+}
+
+template<typename T>
+inline void internal::Accessor::decode_entity(Ref<T>* ref, internal::StringDecoder& decoder) {
+  decoder.decode(ref->_internal_id_);
+  decoder.validate("|");
+  decoder.decode(ref->storage_key_);
+  decoder.validate("|");
+}
+
+template<typename T>
+inline void internal::Accessor::decode_entity(Ref<T>* ref, internal::BinaryDecoder& decoder) {
+  decoder.decode(ref->_internal_id_);
+  decoder.decode(ref->storage_key_);
+}
+
+template<typename T>
+inline void internal::Accessor::encode_entity(const Ref<T>& ref, internal::StringEncoder& encoder) {
+  encoder.encode("", ref._internal_id_);
+  encoder.encode("", ref.storage_key_);
+}
+
+template<typename T>
+inline void internal::Accessor::encode_entity(const Ref<T>& ref, internal::BinaryEncoder& encoder) {
+  encoder.encodeString(ref._internal_id_);
+  encoder.encodeString(ref.storage_key_);
+}
+
+template<typename T>
+inline size_t internal::Accessor::encoded_size(const Ref<T>& ref, const internal::StringEncoder& encoder) {
+  return encoder.size("", ref._internal_id_) + encoder.size("", ref.storage_key_);
+}
+
+template<typename T>
+inline size_t internal::Accessor::encoded_size(const Ref<T>& ref, const internal::BinaryEncoder& encoder) {
+  return encoder.stringSize(ref._internal_id_) + encoder.stringSize(ref.storage_key_);
+}
+
+template<typename T>
+inline const std::string& internal::Accessor::get_id(const Ref<T>& ref) {
+  return ref._internal_id_;
+}
+
+template<typename T>
+inline void internal::Accessor::set_id(Ref<T>* ref, const std::string& id) {
+  ref->_internal_id_ = id;
+}
+
+template<typename T>
+inline void internal::StringDecoder::decode(Ref<T>& ref) {
+  StringDecoder nested(chomp(getInt(':')));
+  Accessor::reset_entity(&ref);
+  Accessor::decode_entity(&ref, nested);
+}
+
+template<typename T>
+inline void internal::BinaryDecoder::decode(Ref<T>& ref) {
+  if (wire_type_ != Bytes) {
+    skip();
+    return;
+  }
+  uint32_t len = getVarint();
+  if (!check(len)) {
+    return;
+  }
+  BinaryDecoder nested(cur_, len);
+  cur_ += len;
+  Accessor::reset_entity(&ref);
+  Accessor::decode_entity(&ref, nested);
+}
+
+template<typename T>
+inline void internal::StringEncoder::encode(const char* prefix, const Ref<T>& ref) {
+  StringEncoder nested;
+  Accessor::encode_entity(ref, nested);
+  encode(prefix, nested.result());
+}
+
+template<typename T>
+inline void internal::BinaryEncoder::encode(int field, const Ref<T>& ref) {
+  putVarint((field << 3) | Bytes);
+  putVarint(Accessor::encoded_size(ref, *this));
+  Accessor::encode_entity(ref, *this);
+}
+
+template<typename T>
+inline size_t internal::StringEncoder::size(const char* prefix, const Ref<T>& ref) const {
+  size_t len = Accessor::encoded_size(ref, *this);
+  size_t digits = 1;
+  for (size_t n = len; n >= 10; n /= 10) {
+    digits++;
+  }
+  return strlen(prefix) + digits + 1 + len + 1;
+}
+
+template<typename T>
+inline size_t internal::BinaryEncoder::size(int field, const Ref<T>& ref) const {
+  size_t len = Accessor::encoded_size(ref, *this);
+  return varintSize((field << 3) | Bytes) + varintSize(len) + len;
+}
+
+template<typename T>
+inline void internal::StringPrinter::add(const char* prefix, const Ref<T>& ref) {
+  parts_.push_back(prefix + entity_to_str(ref));
+}
+
+}  // namespace arcs
+
+// For STL unordered associative containers.
+template<typename T>
+struct std::hash<arcs::Ref<T>> {
+  size_t operator()(const arcs::Ref<T>& ref) const {
+    return arcs::hash_entity(ref);
+  }
+};
+
+namespace arcs {
+
+// --- Materialized views ---
+// Views derive data from a Collection and keep it up to date incrementally. Each change to the
+// collection is pushed through the view chain as row-level changes, so an update costs time in
+// proportion to the number of changed entities rather than the size of the collection. Every
+// view is a set of (key, value) rows: a CollectionView is keyed by entity id, and grouping views
+// by the group key. For example, a particle could count adults per city with:
+//
+//   arcs::CollectionView<arcs::Person> people_{people_handle_};
+//   const auto& per_city_ = people_.filter([](const Person& p) { return p.age() >= 18; })
+//                                  .groupCount([](const Person& p) { return p.city(); })
+//                                  .materialize();
+//
+// Views are owned by the CollectionView (or Join) at the root of their chain, and references
+// returned by the chaining methods stay valid for its lifetime.
+
+template<typename K, typename V> class View;
+template<typename K, typename V> class MaterializedView;
+
+namespace internal {
+
+template<typename F, typename V>
+using ResultOf = std::decay_t<decltype(std::declval<F&>()(std::declval<const V&>()))>;
+
+// Receives the row changes of an upstream view. Each batch of changes ends with flush(); reset()
+// indicates that all rows have been removed, before the upstream contents are sent again.
+template<typename K, typename V>
+class ViewInput {
+public:
+  virtual ~ViewInput() {}
+  virtual void reset() = 0;
+  virtual void upsert(const K& key, const V& value) = 0;
+  virtual void erase(const K& key) = 0;
+  virtual void flush() = 0;
+};
+
+// Root of a view chain; refresh() resends its full contents through the chain.
+class ViewRoot {
+public:
+  virtual ~ViewRoot() {}
+  virtual void refresh() = 0;
+};
+
+template<typename K, typename V, typename P>
+class FilterView : public ViewInput<K, V>, public View<K, V> {
+public:
+  FilterView(ViewRoot* root, P pred) : View<K, V>(root), pred_(std::move(pred)) {}
+
+  void reset() override {
+    passing_.clear();
+    this->emitReset();
+  }
+
+  void upsert(const K& key, const V& value) override {
+    if (pred_(value)) {
+      passing_.insert(key);
+      this->emitUpsert(key, value);
+    } else if (passing_.erase(key)) {
+      this->emitErase(key);
+    }
+  }
+
+  void erase(const K& key) override {
+    if (passing_.erase(key)) {
+      this->emitErase(key);
+    }
+  }
+
+  void flush() override { this->emitFlush(); }
+
+private:
+  P pred_;
+  std::unordered_set<K> passing_;
+};
+
+template<typename K, typename V, typename F>
+class MapView : public ViewInput<K, V>, public View<K, ResultOf<F, V>> {
+public:
+  MapView(ViewRoot* root, F fn) : View<K, ResultOf<F, V>>(root), fn_(std::move(fn)) {}
+
+  void reset() override { this->emitReset(); }
+  void upsert(const K& key, const V& value) override { this->emitUpsert(key, fn_(value)); }
+  void erase(const K& key) override { this->emitErase(key); }
+  void flush() override { this->emitFlush(); }
+
+private:
+  F fn_;
+};
+
+// Aggregates rows by key_fn(value), summing value_fn(value) for each group. Changed groups are
+// collected during a batch and emitted once on flush, and only if their total has changed.
+template<typename K, typename V, typename A, typename KeyFn, typename ValueFn>
+class GroupView : public ViewInput<K, V>, public View<ResultOf<KeyFn, V>, A> {
+  using G = ResultOf<KeyFn, V>;
+
+public:
+  GroupView(ViewRoot* root, KeyFn key_fn, ValueFn value_fn)
+      : View<G, A>(root), key_fn_(std::move(key_fn)), value_fn_(std::move(value_fn)) {}
+
+  void reset() override {
+    rows_.clear();
+    groups_.clear();
+    dirty_.clear();
+    this->emitReset();
+  }
+
+  void upsert(const K& key, const V& value) override {
+    G group = key_fn_(value);
+    A contribution = value_fn_(value);
+    auto it = rows_.find(key);
+    if (it != rows_.end()) {
+      if (it->second.first == group && it->second.second == contribution) {
+        return;
+      }
+      remove(it->second.first, it->second.second);
+      it->second = {group, contribution};
+    } else {
+      rows_.emplace(key, std::make_pair(group, contribution));
+    }
+    add(group, contribution);
+  }
+
+  void erase(const K& key) override {
+    auto it = rows_.find(key);
+    if (it != rows_.end()) {
+      remove(it->second.first, it->second.second);
+      rows_.erase(it);
+    }
+  }
+
+  void flush() override {
+    for (const G& group : dirty_) {
+      auto it = groups_.find(group);
+      Group& state = it->second;
+      if (state.count == 0) {
+        if (state.visible) {
+          this->emitErase(group);
+        }
+        groups_.erase(it);
+      } else if (!state.visible || state.total != state.emitted) {
+        this->emitUpsert(group, state.total);
+        state.visible = true;
+        state.emitted = state.total;
+      }
+    }
+    dirty_.clear();
+    this->emitFlush();
+  }
+
+private:
+  struct Group {
+    size_t count = 0;
+    A total = A();
+    A emitted = A();
+    bool visible = false;
+  };
+
+  void add(const G& group, A contribution) {
+    Group& state = groups_[group];
+    state.count++;
+    state.total += contribution;
+    dirty_.insert(group);
+  }
+
+  void remove(const G& group, A contribution) {
+    Group& state = groups_[group];
+    state.count--;
+    state.total -= contribution;
+    dirty_.insert(group);
+  }
+
+  KeyFn key_fn_;
+  ValueFn value_fn_;
+  std::unordered_map<K, std::pair<G, A>> rows_;  // group and contribution of each input row
+  std::unordered_map<G, Group> groups_;
+  std::unordered_set<G> dirty_;
+};
+
+template<typename K, typename V, typename F>
+class DistinctView : public ViewInput<K, V>, public View<ResultOf<F, V>, ResultOf<F, V>> {
+  using U = ResultOf<F, V>;
+
+public:
+  DistinctView(ViewRoot* root, F fn) : View<U, U>(root), fn_(std::move(fn)) {}
+
+  void reset() override {
+    rows_.clear();
+    refs_.clear();
+    dirty_.clear();
+    this->emitReset();
+  }
+
+  void upsert(const K& key, const V& value) override {
+    U distinct = fn_(value);
+    auto it = rows_.find(key);
+    if (it != rows_.end()) {
+      if (it->second == distinct) {
+        return;
+      }
+      release(it->second);
+      it->second = distinct;
+    } else {
+      rows_.emplace(key, distinct);
     }
+    refs_[distinct].count++;
+    dirty_.insert(distinct);
   }
 
-  void clear() {
-    failForDirection(In);
-    internal::collectionClear(particle_, this);
-    if (dir_ == InOut) {
-      entities_.clear();
+  void erase(const K& key) override {
+    auto it = rows_.find(key);
+    if (it != rows_.end()) {
+      release(it->second);
+      rows_.erase(it);
+    }
+  }
+
+  void flush() override {
+    for (const U& distinct : dirty_) {
+      auto it = refs_.find(distinct);
+      if (it->second.count == 0) {
+        if (it->second.visible) {
+          this->emitErase(distinct);
+        }
+        refs_.erase(it);
+      } else if (!it->second.visible) {
+        this->emitUpsert(distinct, distinct);
+        it->second.visible = true;
+      }
     }
+    dirty_.clear();
+    this->emitFlush();
   }
 
 private:
-  void add(const char* added) {
-    failForDirection(Out);
-    internal::StringDecoder::decodeList(added, [this](const std::string& str) {
-      std::unique_ptr<T> eptr(new T(this));
-      internal::Accessor::decode_entity(eptr.get(), str.c_str());
-      entities_.erase(eptr->_internal_id_);  // emplace doesn't overwrite
-      entities_.emplace(eptr->_internal_id_, std::move(eptr));
-    });
+  struct Refs {
+    size_t count = 0;
+    bool visible = false;
+  };
+
+  void release(const U& distinct) {
+    refs_[distinct].count--;
+    dirty_.insert(distinct);
   }
 
-  Map entities_;
+  F fn_;
+  std::unordered_map<K, U> rows_;
+  std::unordered_map<U, Refs> refs_;
+  std::unordered_set<U> dirty_;
 };
 
-// Arcs-style reference to an entity.
-template<typename T>
-class Ref {
-  struct Payload {
-    T entity;
-    bool dereferenced = false;
-  };
-
+// Mirrors a view's rows into a write handle. Entities are only stored or removed for rows that
+// actually changed; after a reset, rows that come back unchanged keep their stored entities.
+// The writes from each propagation are sent to the host as a single batch when it is flushed.
+template<typename K, typename E>
+class BoundView : public ViewInput<K, E> {
 public:
-  // References are copyable and share a pointer to the underlying entity data.
-  Ref(Handle* handle = nullptr) : handle_(handle), payload_(new Payload()) {}
+  explicit BoundView(Collection<E>* handle) : handle_(handle) {}
 
-  // Retrieve the referenced entity data from the backing store. The first time this is called,
-  // the given continuation will be executed *asynchronously* - i.e. after the calling function has
-  // completed. Care should be taken with values being captured by a continuation lambda. Subsequent
-  // calls will immediately execute the continuation with the previously retrieved entity data.
-  // Example usage:
-  //
-  //   // Given the class field: arcs::Singleton<arcs::Ref<arcs::Data>> data_
-  //   void onHandleUpdate(const std::string& name) override {
-  //     if (name == "data") {
-  //       data_.get().dereference([this] {
-  //         do_something_with(data_.get().entity());
-  //       });
-  //     }
-  //   }
-  //
-  // This method needs to be const because the object is returned as const from handles, but it does
-  // modify the internal state of this object to update a local copy of the retrieved entity data.
-  void dereference(std::function<void()> continuation) const {
-    if (payload_->dereferenced) {
-      continuation();
-    } else if (handle_ != nullptr) {
-      auto wrapped = [this, fn = std::move(continuation)](const char* encoded) {
-        internal::Accessor::decode_entity(&payload_->entity, encoded);
-        payload_->dereferenced = true;
-        fn();
-      };
-      // The handle simply bounces this to its owning particle, adding itself as a parameter.
-      handle_->dereference(_internal_id_, std::move(wrapped));
+  void reset() override {
+    for (auto& entry : stored_) {
+      previous_.insert_or_assign(entry.first, std::move(entry.second));
     }
+    stored_.clear();
   }
 
-  bool is_dereferenced() const {
-    return payload_->dereferenced;
+  void upsert(const K& key, const E& value) override {
+    auto it = stored_.find(key);
+    if (it == stored_.end()) {
+      auto prev = previous_.find(key);
+      if (prev != previous_.end()) {
+        it = stored_.emplace(key, std::move(prev->second)).first;
+        previous_.erase(prev);
+      }
+    }
+    if (it != stored_.end() && Accessor::fields_equal(it->second, value)) {
+      return;
+    }
+    E entity = Accessor::clone_entity(value);
+    if (it != stored_.end()) {
+      Accessor::copy_id(&entity, it->second);
+    }
+    beginBatch();
+    handle_->store(&entity);
+    stored_.insert_or_assign(key, std::move(entity));
   }
 
-  // Returns the underlying entity data. If this object has not been dereferenced yet,
-  // this will be an empty instance of the entity type T.
-  const T& entity() const {
-    return payload_->entity;
+  void erase(const K& key) override {
+    auto it = stored_.find(key);
+    if (it != stored_.end()) {
+      beginBatch();
+      handle_->remove(it->second);
+      stored_.erase(it);
+    }
   }
 
-  // Unlike the generated entity classes, arcs::fields_equal and operator== are equivalent for Refs.
-  bool operator==(const Ref<T>& other) const {
-    return _internal_id_ == other._internal_id_ && storage_key_ == other.storage_key_;
+  // Rows that didn't reappear after a reset have been removed.
+  void flush() override {
+    if (!previous_.empty()) {
+      beginBatch();
+      for (const auto& entry : previous_) {
+        handle_->remove(entry.second);
+      }
+      previous_.clear();
+    }
+    batch_.reset();
   }
 
-  bool operator!=(const Ref<T>& other) const {
-    return !(*this == other);
+private:
+  void beginBatch() {
+    if (!batch_) {
+      batch_.reset(new WriteBatch(handle_->batch()));
+    }
   }
 
-  // For STL containers.
-  friend bool operator<(const Ref<T>& a, const Ref<T>& b) {
-    int cmp = a._internal_id_.compare(b._internal_id_);
-    return (cmp != 0) ? (cmp < 0) : (a.storage_key_.compare(b.storage_key_) < 0);
+  Collection<E>* handle_;
+  std::unique_ptr<WriteBatch> batch_;
+  std::unordered_map<K, E> stored_;
+  std::unordered_map<K, E> previous_;
+};
+
+}  // namespace internal
+
+// A set of (key, value) rows derived from a Collection; see the overview above. Methods return
+// new views chained from this one.
+template<typename K, typename V>
+class View {
+public:
+  View(const View&) = delete;
+  View& operator=(const View&) = delete;
+  virtual ~View() {}
+
+  // Rows for which pred(value) is true.
+  template<typename P>
+  View<K, V>& filter(P pred) {
+    return attach(new internal::FilterView<K, V, P>(root_, std::move(pred)));
+  }
+
+  // Rows with each value replaced by fn(value); for example, projecting entities to a field.
+  template<typename F>
+  View<K, internal::ResultOf<F, V>>& map(F fn) {
+    return attach(new internal::MapView<K, V, F>(root_, std::move(fn)));
+  }
+
+  // One row per distinct key_fn(value), holding the number of rows in that group.
+  template<typename G>
+  View<internal::ResultOf<G, V>, size_t>& groupCount(G key_fn) {
+    auto one = [](const V&) { return size_t(1); };
+    return attach(new internal::GroupView<K, V, size_t, G, decltype(one)>(root_, std::move(key_fn), one));
+  }
+
+  // One row per distinct key_fn(value), holding the sum of value_fn(value) over that group.
+  template<typename G, typename S>
+  View<internal::ResultOf<G, V>, double>& groupSum(G key_fn, S value_fn) {
+    return attach(new internal::GroupView<K, V, double, G, S>(root_, std::move(key_fn), std::move(value_fn)));
+  }
+
+  // One row per distinct fn(value), with that value as both key and value.
+  template<typename F>
+  View<internal::ResultOf<F, V>, internal::ResultOf<F, V>>& distinct(F fn) {
+    return attach(new internal::DistinctView<K, V, F>(root_, std::move(fn)));
+  }
+
+  // Returns a copy of the rows that is kept up to date. Entity-valued views should be mapped to
+  // the required fields first, since entities can't be copied implicitly.
+  const MaterializedView<K, V>& materialize() {
+    return attach(new MaterializedView<K, V>());
+  }
+
+  // Mirrors the rows, which must be entities, into the given write handle: each row is stored as
+  // an entity, and entities are only stored or removed when their rows change.
+  void bindTo(Collection<V>& handle) {
+    attach(new internal::BoundView<K, V>(&handle));
+  }
+
+protected:
+  explicit View(internal::ViewRoot* root) : root_(root) {}
+
+  void emitReset() {
+    for (auto& output : outputs_) output->reset();
+  }
+
+  void emitUpsert(const K& key, const V& value) {
+    for (auto& output : outputs_) output->upsert(key, value);
+  }
+
+  void emitErase(const K& key) {
+    for (auto& output : outputs_) output->erase(key);
+  }
+
+  void emitFlush() {
+    for (auto& output : outputs_) output->flush();
   }
 
 private:
-  std::string _internal_id_;
-  std::string storage_key_;
-  Handle* handle_;
-  std::shared_ptr<Payload> payload_;
+  // Resends the root's contents so the new output starts up to date; the existing outputs
+  // handle this as a reset followed by unchanged rows.
+  template<typename N>
+  N& attach(N* output) {
+    outputs_.emplace_back(output);
+    root_->refresh();
+    return *output;
+  }
 
-  friend class Singleton<Ref<T>>;
-  friend class Collection<Ref<T>>;
-  friend class internal::Accessor;
+  internal::ViewRoot* root_;
+  std::vector<std::unique_ptr<internal::ViewInput<K, V>>> outputs_;
 };
 
-template<typename T>
-inline Ref<T> internal::Accessor::clone_entity(const Ref<T>& ref) {
-  return ref;
-}
+// The rows of a view, kept up to date; see View::materialize().
+template<typename K, typename V>
+class MaterializedView : public internal::ViewInput<K, V> {
+public:
+  using Rows = std::unordered_map<K, V>;
 
-template<typename T>
-inline size_t internal::Accessor::hash_entity(const Ref<T>& ref) {
-  size_t h = 0;
-  internal::hash_combine(h, ref._internal_id_);
-  internal::hash_combine(h, ref.storage_key_);
-  return h;
-}
+  size_t size() const { return rows_.size(); }
+  bool empty() const { return rows_.empty(); }
 
-template<typename T>
-inline bool internal::Accessor::fields_equal(const Ref<T>& a, const Ref<T>& b) {
-  return a == b;
-}
+  // Returns the value for the given key, or nullptr if there is no such row.
+  const V* find(const K& key) const {
+    auto it = rows_.find(key);
+    return (it != rows_.end()) ? &it->second : nullptr;
+  }
+
+  typename Rows::const_iterator begin() const { return rows_.begin(); }
+  typename Rows::const_iterator end() const { return rows_.end(); }
+
+private:
+  void reset() override { rows_.clear(); }
+  void upsert(const K& key, const V& value) override { rows_.insert_or_assign(key, value); }
+  void erase(const K& key) override { rows_.erase(key); }
+  void flush() override {}
 
+  Rows rows_;
+};
+
+// Root of a view chain over a readable Collection, keyed by entity id. Must be declared after the
+// collection it reads from, and is updated before Particle::onHandleSync/onHandleUpdate.
 template<typename T>
-inline std::string internal::Accessor::entity_to_str(const Ref<T>& ref, const char* unused) {
-  internal::StringPrinter printer;
-  printer.add("REF<", ref._internal_id_);
-  if (!ref.storage_key_.empty()) {
-    printer.add("|", ref.storage_key_);
-  }
-  if (ref.is_dereferenced()) {
-    printer.add("|", entity_to_str(ref.entity(), ", "));
+class CollectionView : private internal::ViewRoot, public View<internal::Id, T> {
+public:
+  explicit CollectionView(Collection<T>& collection)
+      : View<internal::Id, T>(this), collection_(collection) {
+    collection_.onSync([this] { refresh(); });
+    collection_.onUpdate([this](const CollectionDelta<T>& delta) {
+      for (const T& entity : delta.removed) {
+        this->emitErase(internal::Accessor::id(entity));
+      }
+      for (const auto* entities : {&delta.added, &delta.changed}) {
+        for (const T* entity : *entities) {
+          this->emitUpsert(internal::Accessor::id(*entity), *entity);
+        }
+      }
+      this->emitFlush();
+    });
   }
-  printer.add(">");
-  return printer.result("");
-}
 
-template<typename T>
-inline void internal::Accessor::decode_entity(Ref<T>* ref, const char* str) {
-  if (str != nullptr) {
-    internal::StringDecoder decoder(str);
-    decoder.decode(ref->_internal_id_);
-    decoder.validate("|");
-    decoder.decode(ref->storage_key_);
-    decoder.validate("|");
+private:
+  void refresh() override {
+    this->emitReset();
+    for (const T& entity : collection_) {
+      this->emitUpsert(internal::Accessor::id(entity), entity);
+    }
+    this->emitFlush();
   }
-}
 
-template<typename T>
-inline std::string internal::Accessor::encode_entity(const Ref<T>& ref) {
-  internal::StringEncoder encoder;
-  encoder.encode("", ref._internal_id_);
-  encoder.encode("", ref.storage_key_);
-  return encoder.result();
-}
+  Collection<T>& collection_;
+};
 
-template<typename T>
-inline const std::string& internal::Accessor::get_id(const Ref<T>& ref) {
-  return ref._internal_id_;
-}
+// --- Joins ---
 
-template<typename T>
-inline void internal::Accessor::set_id(Ref<T>* ref, const std::string& id) {
-  ref->_internal_id_ = id;
-}
+enum class JoinType { Inner, Left };
 
-template<typename T>
-inline void internal::StringPrinter::add(const char* prefix, const Ref<T>& ref) {
-  parts_.push_back(prefix + entity_to_str(ref));
-}
+// Identifies an output row of a Join by the ids of the joined entities. The right id is empty for
+// left entities with no match in a left join.
+struct JoinKey {
+  internal::Id left;
+  internal::Id right;
+
+  friend bool operator==(const JoinKey& a, const JoinKey& b) {
+    return a.left == b.left && a.right == b.right;
+  }
+  friend bool operator!=(const JoinKey& a, const JoinKey& b) { return !(a == b); }
+};
+
+// The joined entities for an output row. Pointers are only valid while the row is being passed
+// to a view, or during a Join::forEach() callback.
+template<typename L, typename R>
+struct JoinRow {
+  const L* left;
+  const R* right;  // nullptr for left entities with no match in a left join
+};
 
 }  // namespace arcs
 
-// For STL unordered associative containers.
-template<typename T>
-struct std::hash<arcs::Ref<T>> {
-  size_t operator()(const arcs::Ref<T>& ref) const {
-    return arcs::hash_entity(ref);
+template<>
+struct std::hash<arcs::JoinKey> {
+  size_t operator()(const arcs::JoinKey& key) const {
+    size_t h = 0;
+    arcs::internal::hash_combine(h, key.left);
+    arcs::internal::hash_combine(h, key.right);
+    return h;
   }
 };
 
 namespace arcs {
 
+// Equi-join of two readable Collections on a key computed from each side's entities, for example:
+//
+//   arcs::Join<Product, Review, std::string> reviewed_{
+//       products_, reviews_, &Product::name, &Review::product, arcs::JoinType::Left};
+//
+// Each side is hashed on its join key, and updates to either handle only touch the rows for the
+// changed entities' keys. The result can be read directly with forEach(), or used as the root of
+// a view chain (see View); views must copy what they need from the JoinRow pointers, for example
+// with map(). Must be declared after both collections.
+template<typename L, typename R, typename J>
+class Join : private internal::ViewRoot, public View<JoinKey, JoinRow<L, R>> {
+public:
+  Join(Collection<L>& left, Collection<R>& right, std::function<J(const L&)> left_key,
+       std::function<J(const R&)> right_key, JoinType type = JoinType::Inner)
+      : View<JoinKey, JoinRow<L, R>>(this), left_(left, std::move(left_key)),
+        right_(right, std::move(right_key)), type_(type) {
+    left.onSync([this] { refresh(); });
+    right.onSync([this] { refresh(); });
+    left.onUpdate([this](const CollectionDelta<L>& delta) {
+      for (const L& entity : delta.removed) {
+        eraseLeft(internal::Accessor::id(entity));
+      }
+      for (const auto* entities : {&delta.added, &delta.changed}) {
+        for (const L* entity : *entities) {
+          upsertLeft(*entity);
+        }
+      }
+      this->emitFlush();
+    });
+    right.onUpdate([this](const CollectionDelta<R>& delta) {
+      for (const R& entity : delta.removed) {
+        eraseRight(internal::Accessor::id(entity));
+      }
+      for (const auto* entities : {&delta.added, &delta.changed}) {
+        for (const R* entity : *entities) {
+          upsertRight(*entity);
+        }
+      }
+      this->emitFlush();
+    });
+  }
+
+  // Calls fn(const L&, const R*) for each output row, in no particular order.
+  template<typename F>
+  void forEach(F fn) const {
+    for (const auto& [key, lefts] : left_.ids) {
+      const std::vector<internal::Id>* rights = right_.matches(key);
+      for (const internal::Id& a : lefts) {
+        const L* left = left_.handle.get(a);
+        if (rights != nullptr) {
+          for (const internal::Id& b : *rights) {
+            fn(*left, right_.handle.get(b));
+          }
+        } else if (type_ == JoinType::Left) {
+          fn(*left, static_cast<const R*>(nullptr));
+        }
+      }
+    }
+  }
+
+  // Returns the number of output rows; takes time proportional to the number of distinct keys.
+  size_t size() const {
+    size_t count = 0;
+    for (const auto& [key, lefts] : left_.ids) {
+      const std::vector<internal::Id>* rights = right_.matches(key);
+      if (rights != nullptr) {
+        count += lefts.size() * rights->size();
+      } else if (type_ == JoinType::Left) {
+        count += lefts.size();
+      }
+    }
+    return count;
+  }
+
+private:
+  // The join key of each entity on one side, and the entities with each key.
+  template<typename T>
+  struct Side {
+    Side(Collection<T>& handle, std::function<J(const T&)> key_fn)
+        : handle(handle), key_fn(std::move(key_fn)) {}
+
+    const std::vector<internal::Id>* matches(const J& key) const {
+      auto it = ids.find(key);
+      return (it != ids.end()) ? &it->second : nullptr;
+    }
+
+    void add(const internal::Id& id, const J& key) {
+      keys.insert_or_assign(id, key);
+      ids[key].push_back(id);
+    }
+
+    void remove(const internal::Id& id, const J& key) {
+      auto it = ids.find(key);
+      std::vector<internal::Id>& group = it->second;
+      for (size_t i = 0; i < group.size(); i++) {
+        if (group[i] == id) {
+          group[i] = std::move(group.back());
+          group.pop_back();
+          break;
+        }
+      }
+      if (group.empty()) {
+        ids.erase(it);
+      }
+      keys.erase(id);
+    }
+
+    void clear() {
+      keys.clear();
+      ids.clear();
+    }
+
+    Collection<T>& handle;
+    std::function<J(const T&)> key_fn;
+    std::unordered_map<internal::Id, J> keys;
+    std::unordered_map<J, std::vector<internal::Id>> ids;
+  };
+
+  void refresh() override {
+    this->emitReset();
+    left_.clear();
+    right_.clear();
+    for (const R& entity : right_.handle) {
+      right_.add(internal::Accessor::id(entity), right_.key_fn(entity));
+    }
+    for (const L& entity : left_.handle) {
+      const internal::Id& id = internal::Accessor::id(entity);
+      J key = left_.key_fn(entity);
+      left_.add(id, key);
+      publishLeft(id, entity, key);
+    }
+    this->emitFlush();
+  }
+
+  void publishLeft(const internal::Id& a, const L& left, const J& key) {
+    if (const std::vector<internal::Id>* rights = right_.matches(key)) {
+      for (const internal::Id& b : *rights) {
+        this->emitUpsert({a, b}, {&left, right_.handle.get(b)});
+      }
+    } else if (type_ == JoinType::Left) {
+      this->emitUpsert({a, {}}, {&left, nullptr});
+    }
+  }
+
+  void retractLeft(const internal::Id& a, const J& key) {
+    if (const std::vector<internal::Id>* rights = right_.matches(key)) {
+      for (const internal::Id& b : *rights) {
+        this->emitErase({a, b});
+      }
+    } else if (type_ == JoinType::Left) {
+      this->emitErase({a, {}});
+    }
+  }
+
+  void upsertLeft(const L& entity) {
+    const internal::Id& a = internal::Accessor::id(entity);
+    J key = left_.key_fn(entity);
+    auto it = left_.keys.find(a);
+    if (it == left_.keys.end()) {
+      left_.add(a, key);
+    } else if (it->second != key) {
+      J old = it->second;
+      retractLeft(a, old);
+      left_.remove(a, old);
+      left_.add(a, key);
+    }
+    publishLeft(a, entity, key);
+  }
+
+  void eraseLeft(const internal::Id& a) {
+    auto it = left_.keys.find(a);
+    if (it != left_.keys.end()) {
+      J old = it->second;
+      retractLeft(a, old);
+      left_.remove(a, old);
+    }
+  }
+
+  // Called after b has been added to its key group; 'added' is false if it was already there.
+  void publishRight(const internal::Id& b, const R& right, const J& key, bool added) {
+    const std::vector<internal::Id>* lefts = left_.matches(key);
+    if (lefts == nullptr) {
+      return;
+    }
+    bool first = added && right_.matches(key)->size() == 1;
+    for (const internal::Id& a : *lefts) {
+      if (first && type_ == JoinType::Left) {
+        this->emitErase({a, {}});
+      }
+      this->emitUpsert({a, b}, {left_.handle.get(a), &right});
+    }
+  }
+
+  // Called before b is removed from its key group.
+  void retractRight(const internal::Id& b, const J& key) {
+    const std::vector<internal::Id>* lefts = left_.matches(key);
+    if (lefts == nullptr) {
+      return;
+    }
+    bool last = right_.matches(key)->size() == 1;
+    for (const internal::Id& a : *lefts) {
+      this->emitErase({a, b});
+      if (last && type_ == JoinType::Left) {
+        this->emitUpsert({a, {}}, {left_.handle.get(a), nullptr});
+      }
+    }
+  }
+
+  void upsertRight(const R& entity) {
+    const internal::Id& b = internal::Accessor::id(entity);
+    J key = right_.key_fn(entity);
+    auto it = right_.keys.find(b);
+    bool added = true;
+    if (it == right_.keys.end()) {
+      right_.add(b, key);
+    } else if (it->second != key) {
+      J old = it->second;
+      retractRight(b, old);
+      right_.remove(b, old);
+      right_.add(b, key);
+    } else {
+      added = false;
+    }
+    publishRight(b, entity, key, added);
+  }
+
+  void eraseRight(const internal::Id& b) {
+    auto it = right_.keys.find(b);
+    if (it != right_.keys.end()) {
+      J old = it->second;
+      retractRight(b, old);
+      right_.remove(b, old);
+    }
+  }
+
+  Side<L> left_;
+  Side<R> right_;
+  JoinType type_;
+};
+
 // --- Particle base class ---
 // TODO: port sync tracking and auto-render to the JS particle.
 
+// Builds a render model with typed values, encoding it directly into the buffer that is sent to
+// the host. Lists of records are rendered by stamping out the named <template> element for each
+// record, so large lists don't need to be converted to strings; for example:
+//
+//   writer->set("count", items_.size());
+//   writer->beginList("items", "item_template");
+//   for (const arcs::Item& item : items_) {
+//     writer->beginRecord();
+//     writer->set("name", item.name()).set("price", item.price());
+//     writer->endRecord();
+//   }
+//   writer->endList();
+//
+// Records may contain nested lists. Each beginList() and beginRecord() call must be matched by
+// the corresponding end call.
+class ModelWriter {
+public:
+  ModelWriter();
+
+  ModelWriter& set(std::string_view key, std::string_view value);
+  ModelWriter& set(std::string_view key, const char* value) {
+    return set(key, std::string_view(value));
+  }
+  ModelWriter& set(std::string_view key, bool value);
+
+  // Any other arithmetic type is written as a number.
+  template<typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+  ModelWriter& set(std::string_view key, T value) {
+    return setNumber(key, static_cast<double>(value));
+  }
+
+  // If 'template_name' is empty, the list is passed to the host as a plain array.
+  void beginList(std::string_view key, std::string_view template_name = {});
+  void beginRecord();
+  void endRecord();
+  void endList();
+
+  // Returns true if nothing has been written.
+  bool empty() const { return encoded_.size() == 1; }
+
+  // Format: M<entry><entry>... (see src/runtime/wasm.ts)
+  const std::string& encoded() const { return encoded_; }
+  std::string release() { return std::move(encoded_); }
+
+private:
+  ModelWriter& setNumber(std::string_view key, double value);
+  void appendKey(std::string_view key);
+
+  std::string encoded_;
+};
+
 class Particle {
 public:
   virtual ~Particle() {}
@@ -601,7 +2868,9 @@ public:
 
   // Particle constructors may call this to indicate that the particle should automatically invoke
   // renderSlot() with the given slot name once all connected handles are synced, and thereafter
-  // whenever a handle is updated.
+  // whenever a handle is updated. Automatic renders are scheduled by the runtime, so several
+  // updates may result in a single render, and are skipped if neither the template nor the model
+  // has changed since the last render of the slot.
   void autoRender(const std::string& slot_name = "root");
 
   // Called once a particle has been set up. Initial processing and service requests may be
@@ -641,12 +2910,30 @@ public:
   // that can be substituted for data values provided by populateModel().
   virtual std::string getTemplate(const std::string& slot_name) { return ""; }
 
+  // Override instead of getTemplate() to provide a template without allocating. The viewed
+  // characters must remain valid and unchanged for the lifetime of the particle: the template is
+  // only re-read when the view's pointer or size changes, so a buffer edited in place keeps
+  // rendering the old template. Typically this returns a constant:
+  //
+  //   static constexpr std::string_view kTemplate = "<div>{{name}}</div>";
+  //   std::string_view getTemplateView(const std::string& slot_name) override { return kTemplate; }
+  //
+  // A default-constructed view (the default) falls back to getTemplate().
+  virtual std::string_view getTemplateView(const std::string& slot_name) { return {}; }
+
   // Override to populate a model mapping the template {{placeholders}} to the current data values.
   virtual void populateModel(const std::string& slot_name, Dictionary* model) {}
 
+  // Override instead of populateModel() to write the model with typed values, including lists of
+  // records, without building a Dictionary of strings. If nothing is written, populateModel() is
+  // used.
+  virtual void writeModel(const std::string& slot_name, ModelWriter* model) {}
+
   // Call to trigger a render from within the particle. 'send_template' and 'send_model' instruct
   // the system to call getTemplate() and populateModel() for this render, respectively. Also
-  // invoked when auto-render is enabled after all readable handles have been synchronized.
+  // invoked when auto-render is enabled after all readable handles have been synchronized. Each
+  // distinct template is only sent to the host once, and only the model entries that have changed
+  // since the slot's last render are sent.
   // TODO: it doesn't make sense to have both send flags false; ignore, error or convert to enum?
   void renderSlot(const std::string& slot_name, bool send_template = true, bool send_model = true);
 
@@ -672,8 +2959,10 @@ public:
   // -- Internal API --
   // These are public to allow access from the runtime, but should not be called by sub-classes.
 
-  // Called by the runtime to associate the inner handle instance with the outer object.
-  Handle* connectHandle(const char* name, bool can_read, bool can_write);
+  // Called by the runtime to associate the inner handle instance with the outer object. Writable
+  // handles may be given an initial id prefix (see Handle::newId).
+  Handle* connectHandle(const char* name, bool can_read, bool can_write,
+                        const char* id_prefix = nullptr);
 
   // Called by the runtime to synchronize a handle.
   void sync(Handle* handle);
@@ -681,24 +2970,65 @@ public:
   // Called by the runtime to update a handle.
   void update(Handle* handle);
 
+  // Called by the runtime to render a slot on the host's behalf. The host may not have the slot's
+  // previous renders, so the full model is sent.
+  void requestRender(const char* slot_name, bool send_template, bool send_model);
+
+  // Called by the runtime to perform an automatic render requested via scheduleRender().
+  void flushRender();
+
   // Called by handles on behalf of their contained reference objects. The runtime will
   // retrieve the entity data for the reference and pass it to dereferenceResponse().
   void dereference(Handle* handle, const std::string& ref_id, internal::DerefContinuation fn) {
-    continuations_.emplace(++continuation_id_, std::move(fn));
-    internal::dereference(this, handle, ref_id.c_str(), continuation_id_);
+    size_t continuation_id;
+    if (free_continuations_.empty()) {
+      continuation_id = continuations_.size();
+      continuations_.push_back(std::move(fn));
+    } else {
+      continuation_id = free_continuations_.back();
+      free_continuations_.pop_back();
+      continuations_[continuation_id] = std::move(fn);
+    }
+    internal::dereference(this, handle, ref_id.c_str(), continuation_id);
   }
 
   void dereferenceResponse(size_t continuation_id, const char* encoded) {
-    continuations_[continuation_id](encoded);
-    continuations_.erase(continuation_id);
+    // Release the slot before running the continuation, which may itself call dereference().
+    internal::DerefContinuation fn = std::move(continuations_[continuation_id]);
+    continuations_[continuation_id] = {};
+    free_continuations_.push_back(continuation_id);
+    fn(encoded);
   }
 
 private:
+  // The template and model last sent to the host for a slot. 'template_view' is only set for
+  // templates provided by getTemplateView(). Models from writeModel() are kept in their encoded
+  // form, in which case 'typed_model' is set.
+  struct RenderedSlot {
+    std::string_view template_view;
+    uint64_t template_hash = 0;
+    Dictionary model;
+    std::string encoded_model;
+    bool has_template = false;
+    bool has_model = false;
+    bool typed_model = false;
+  };
+
+  void render(const std::string& slot_name, bool send_template, bool send_model,
+              bool skip_unchanged);
+  void scheduleAutoRender();
+
   std::unordered_map<std::string, Handle*> handles_;
   std::unordered_set<Handle*> to_sync_;
   std::string auto_render_slot_;
-  std::unordered_map<size_t, internal::DerefContinuation> continuations_;
-  size_t continuation_id_ = 0;
+  bool render_scheduled_ = false;
+  std::unordered_map<std::string, RenderedSlot> rendered_;
+  // Content hashes of the templates registered with the host.
+  std::unordered_set<uint64_t> registered_templates_;
+  // Pending dereference continuations, indexed by the ids passed to the runtime. Slots are
+  // recycled via the free list so steady-state dereferencing doesn't allocate.
+  std::vector<internal::DerefContinuation> continuations_;
+  std::vector<size_t> free_continuations_;
 };
 
 inline void Handle::dereference(const std::string& ref_id, internal::DerefContinuation fn) {
@@ -20,24 +20,24 @@ public:
   Data& operator=(Data&&) = default;
 
   double num() const { return num_; }
-  void set_num(double value) { num_ = value; num_valid_ = true; }
-  void clear_num() { num_ = double(); num_valid_ = false; }
-  bool has_num() const { return num_valid_; }
+  void set_num(double value) { num_ = value; _valid_.set(0); }
+  void clear_num() { num_ = double(); _valid_.reset(0); }
+  bool has_num() const { return _valid_.test(0); }
 
   const std::string& txt() const { return txt_; }
-  void set_txt(const std::string& value) { txt_ = value; txt_valid_ = true; }
-  void clear_txt() { txt_ = std::string(); txt_valid_ = false; }
-  bool has_txt() const { return txt_valid_; }
+  void set_txt(const std::string& value) { txt_ = value; _valid_.set(1); }
+  void clear_txt() { txt_ = std::string(); _valid_.reset(1); }
+  bool has_txt() const { return _valid_.test(1); }
 
   const URL& lnk() const { return lnk_; }
-  void set_lnk(const URL& value) { lnk_ = value; lnk_valid_ = true; }
-  void clear_lnk() { lnk_ = URL(); lnk_valid_ = false; }
-  bool has_lnk() const { return lnk_valid_; }
+  void set_lnk(const URL& value) { lnk_ = value; _valid_.set(2); }
+  void clear_lnk() { lnk_ = URL(); _valid_.reset(2); }
+  bool has_lnk() const { return _valid_.test(2); }
 
   bool flg() const { return flg_; }
-  void set_flg(bool value) { flg_ = value; flg_valid_ = true; }
-  void clear_flg() { flg_ = bool(); flg_valid_ = false; }
-  bool has_flg() const { return flg_valid_; }
+  void set_flg(bool value) { flg_ = value; _valid_.set(3); }
+  void clear_flg() { flg_ = bool(); _valid_.reset(3); }
+  bool has_flg() const { return _valid_.test(3); }
 
   // Equality ops compare internal ids and all data fields.
   // Use arcs::fields_equal() to compare only the data fields.
@@ -48,26 +48,26 @@ public:
   friend bool operator<(const Data& a, const Data& b) {
     int cmp = a._internal_id_.compare(b._internal_id_);
     if (cmp != 0) return cmp < 0;
-    if (a.num_valid_ != b.num_valid_) {
-      return !a.num_valid_;
-    } else if (a.num_ != b.num_) {
+    if (a._valid_.test(0) != b._valid_.test(0)) {
+      return !a._valid_.test(0);
+    } else if (a._valid_.test(0) && a.num_ != b.num_) {
       return a.num_ < b.num_;
     }
-    if (a.txt_valid_ != b.txt_valid_) {
-      return !a.txt_valid_;
-    } else {
+    if (a._valid_.test(1) != b._valid_.test(1)) {
+      return !a._valid_.test(1);
+    } else if (a._valid_.test(1)) {
       cmp = a.txt_.compare(b.txt_);
       if (cmp != 0) return cmp < 0;
     }
-    if (a.lnk_valid_ != b.lnk_valid_) {
-      return !a.lnk_valid_;
-    } else {
+    if (a._valid_.test(2) != b._valid_.test(2)) {
+      return !a._valid_.test(2);
+    } else if (a._valid_.test(2)) {
       cmp = a.lnk_.compare(b.lnk_);
       if (cmp != 0) return cmp < 0;
     }
-    if (a.flg_valid_ != b.flg_valid_) {
-      return !a.flg_valid_;
-    } else if (a.flg_ != b.flg_) {
+    if (a._valid_.test(3) != b._valid_.test(3)) {
+      return !a._valid_.test(3);
+    } else if (a._valid_.test(3) && a.flg_ != b.flg_) {
       return a.flg_ < b.flg_;
     };
     return false;
@@ -81,61 +81,112 @@ private:
   Data(const Data&) = default;
   Data& operator=(const Data&) = default;
 
+  // Members are ordered by alignment to avoid padding; bit i of _valid_ is set if field i (in
+  // schema order) has a value.
   double num_ = double();
-  bool num_valid_ = false;
-
   std::string txt_ = std::string();
-  bool txt_valid_ = false;
-
   URL lnk_ = URL();
-  bool lnk_valid_ = false;
-
+  internal::Id _internal_id_;
   bool flg_ = bool();
-  bool flg_valid_ = false;
-
-  std::string _internal_id_;
+  internal::FieldMask<4> _valid_;
   static const int _FIELD_COUNT = 4;
 
+  // Maps text-format field names to field indices; returns -1 for unknown fields.
+  static constexpr int _field_index(std::string_view name) {
+    switch (name.size()) {
+      case 3:
+        switch (name[0]) {
+          case 'f': return name == "flg" ? 3 : -1;
+          case 'l': return name == "lnk" ? 2 : -1;
+          case 'n': return name == "num" ? 0 : -1;
+          case 't': return name == "txt" ? 1 : -1;
+        }
+        break;
+    }
+    return -1;
+  }
+
   friend class Singleton<Data>;
   friend class Collection<Data>;
+  friend class Columns<Data>;
   friend class internal::Accessor;
 };
 
+template<>
+class Columns<Data> {
+public:
+  size_t size() const { return size_; }
+  const Column<double>& num() const { return num_; }
+  const Column<bool>& flg() const { return flg_; }
+
+private:
+  void resize(size_t size) {
+    size_ = size;
+    num_.resize(size);
+    flg_.resize(size);
+  }
+
+  void assign(size_t row, const Data& entity) {
+    num_.assign(row, entity.num_, entity._valid_.test(0));
+    flg_.assign(row, entity.flg_, entity._valid_.test(3));
+  }
+
+  void swap_remove(size_t row) {
+    size_--;
+    num_.swap_remove(row);
+    flg_.swap_remove(row);
+  }
+
+  size_t size_ = 0;
+  Column<double> num_;
+  Column<bool> flg_;
+
+  friend class Collection<Data>;
+};
+
 template<>
 inline Data internal::Accessor::clone_entity(const Data& entity) {
   Data clone;
   clone.num_ = entity.num_;
-  clone.num_valid_ = entity.num_valid_;
   clone.txt_ = entity.txt_;
-  clone.txt_valid_ = entity.txt_valid_;
   clone.lnk_ = entity.lnk_;
-  clone.lnk_valid_ = entity.lnk_valid_;
   clone.flg_ = entity.flg_;
-  clone.flg_valid_ = entity.flg_valid_;
+  clone._valid_ = entity._valid_;
   return clone;
 }
 
+template<>
+inline void internal::Accessor::reset_entity(Data* entity) {
+  entity->_internal_id_ = internal::Id();
+  entity->num_ = double();
+  entity->txt_.clear();
+  entity->lnk_.clear();
+  entity->flg_ = bool();
+  entity->_valid_.clear();
+}
+
 template<>
 inline size_t internal::Accessor::hash_entity(const Data& entity) {
   size_t h = 0;
   internal::hash_combine(h, entity._internal_id_);
-  if (entity.num_valid_)
+  if (entity._valid_.test(0))
     internal::hash_combine(h, entity.num_);
-  if (entity.txt_valid_)
+  if (entity._valid_.test(1))
     internal::hash_combine(h, entity.txt_);
-  if (entity.lnk_valid_)
+  if (entity._valid_.test(2))
     internal::hash_combine(h, entity.lnk_);
-  if (entity.flg_valid_)
+  if (entity._valid_.test(3))
     internal::hash_combine(h, entity.flg_);
   return h;
 }
 
 template<>
 inline bool internal::Accessor::fields_equal(const Data& a, const Data& b) {
-  return (a.num_valid_ ? (b.num_valid_ && a.num_ == b.num_) : !b.num_valid_) &&
-         (a.txt_valid_ ? (b.txt_valid_ && a.txt_ == b.txt_) : !b.txt_valid_) &&
-         (a.lnk_valid_ ? (b.lnk_valid_ && a.lnk_ == b.lnk_) : !b.lnk_valid_) &&
-         (a.flg_valid_ ? (b.flg_valid_ && a.flg_ == b.flg_) : !b.flg_valid_);
+  return a._valid_ == b._valid_ &&
+         (!a._valid_.test(0) || a.num_ == b.num_) &&
+         (!a._valid_.test(1) || a.txt_ == b.txt_) &&
+         (!a._valid_.test(2) || a.lnk_ == b.lnk_) &&
+         (!a._valid_.test(3) || a.flg_ == b.flg_);
 }
 
 inline bool Data::operator==(const Data& other) const {
@@ -146,60 +197,266 @@ template<>
 inline std::string internal::Accessor::entity_to_str(const Data& entity, const char* join) {
   internal::StringPrinter printer;
   printer.addId(entity._internal_id_);
-  if (entity.num_valid_)
+  if (entity._valid_.test(0))
     printer.add("num: ", entity.num_);
-  if (entity.txt_valid_)
+  if (entity._valid_.test(1))
     printer.add("txt: ", entity.txt_);
-  if (entity.lnk_valid_)
+  if (entity._valid_.test(2))
     printer.add("lnk: ", entity.lnk_);
-  if (entity.flg_valid_)
+  if (entity._valid_.test(3))
     printer.add("flg: ", entity.flg_);
   return printer.result(join);
 }
 
 template<>
-inline void internal::Accessor::decode_entity(Data* entity, const char* str) {
-  if (str == nullptr) return;
-  internal::StringDecoder decoder(str);
+inline void internal::Accessor::decode_entity(Data* entity, internal::StringDecoder& decoder) {
   decoder.decode(entity->_internal_id_);
   decoder.validate("|");
-  for (int i = 0; !decoder.done() && i < Data::_FIELD_COUNT; i++) {
-    std::string name = decoder.upTo(':');
-    if (0) {
-    } else if (name == "num") {
-      decoder.validate("N");
-      decoder.decode(entity->num_);
-      entity->num_valid_ = true;
-    } else if (name == "txt") {
-      decoder.validate("T");
-      decoder.decode(entity->txt_);
-      entity->txt_valid_ = true;
-    } else if (name == "lnk") {
-      decoder.validate("U");
-      decoder.decode(entity->lnk_);
-      entity->lnk_valid_ = true;
-    } else if (name == "flg") {
-      decoder.validate("B");
-      decoder.decode(entity->flg_);
-      entity->flg_valid_ = true;
+  while (!decoder.done()) {
+    switch (Data::_field_index(decoder.upTo(':'))) {
+      case 0:
+        decoder.validate("N");
+        decoder.decode(entity->num_);
+        entity->_valid_.set(0);
+        break;
+      case 1:
+        decoder.validate("T");
+        decoder.decode(entity->txt_);
+        entity->_valid_.set(1);
+        break;
+      case 2:
+        decoder.validate("U");
+        decoder.decode(entity->lnk_);
+        entity->_valid_.set(2);
+        break;
+      case 3:
+        decoder.validate("B");
+        decoder.decode(entity->flg_);
+        entity->_valid_.set(3);
+        break;
+      default:
+        decoder.skip();
     }
     decoder.validate("|");
   }
 }
 
 template<>
-inline std::string internal::Accessor::encode_entity(const Data& entity) {
-  internal::StringEncoder encoder;
+inline void internal::Accessor::decode_entity(Data* entity, internal::BinaryDecoder& decoder) {
+  decoder.decode(entity->_internal_id_);
+  while (!decoder.done()) {
+    switch (decoder.field()) {
+      case 0:
+        decoder.decode(entity->num_);
+        entity->_valid_.set(0);
+        break;
+      case 1:
+        decoder.decode(entity->txt_);
+        entity->_valid_.set(1);
+        break;
+      case 2:
+        decoder.decode(entity->lnk_);
+        entity->_valid_.set(2);
+        break;
+      case 3:
+        decoder.decode(entity->flg_);
+        entity->_valid_.set(3);
+        break;
+      default:
+        decoder.skip();
+    }
+  }
+}
+
+template<>
+inline void internal::Accessor::encode_entity(const Data& entity, internal::StringEncoder& encoder) {
   encoder.encode("", entity._internal_id_);
-  if (entity.num_valid_)
+  if (entity._valid_.test(0))
     encoder.encode("num:N", entity.num_);
-  if (entity.txt_valid_)
+  if (entity._valid_.test(1))
     encoder.encode("txt:T", entity.txt_);
-  if (entity.lnk_valid_)
+  if (entity._valid_.test(2))
     encoder.encode("lnk:U", entity.lnk_);
-  if (entity.flg_valid_)
+  if (entity._valid_.test(3))
     encoder.encode("flg:B", entity.flg_);
-  return encoder.result();
+}
+
+template<>
+inline void internal::Accessor::encode_entity(const Data& entity, internal::BinaryEncoder& encoder) {
+  encoder.encodeString(entity._internal_id_);
+  if (entity._valid_.test(0))
+    encoder.encode(0, entity.num_);
+  if (entity._valid_.test(1))
+    encoder.encode(1, entity.txt_);
+  if (entity._valid_.test(2))
+    encoder.encode(2, entity.lnk_);
+  if (entity._valid_.test(3))
+    encoder.encode(3, entity.flg_);
+}
+
+template<>
+inline size_t internal::Accessor::encoded_size(const Data& entity, const internal::StringEncoder& encoder) {
+  size_t size = encoder.size("", entity._internal_id_);
+  if (entity._valid_.test(0))
+    size += encoder.size("num:N", entity.num_);
+  if (entity._valid_.test(1))
+    size += encoder.size("txt:T", entity.txt_);
+  if (entity._valid_.test(2))
+    size += encoder.size("lnk:U", entity.lnk_);
+  if (entity._valid_.test(3))
+    size += encoder.size("flg:B", entity.flg_);
+  return size;
+}
+
+template<>
+inline size_t internal::Accessor::encoded_size(const Data& entity, const internal::BinaryEncoder& encoder) {
+  size_t size = encoder.stringSize(entity._internal_id_);
+  if (entity._valid_.test(0))
+    size += encoder.size(0, entity.num_);
+  if (entity._valid_.test(1))
+    size += encoder.size(1, entity.txt_);
+  if (entity._valid_.test(2))
+    size += encoder.size(2, entity.lnk_);
+  if (entity._valid_.test(3))
+    size += encoder.size(3, entity.flg_);
+  return size;
+}
+
+template<>
+inline void internal::Accessor::diff_entity(const Data& from, const Data& to, internal::StringEncoder& encoder) {
+  if (to._valid_.test(0)) {
+    if (!from._valid_.test(0) || from.num_ != to.num_) encoder.encode("num:N", to.num_);
+  } else if (from._valid_.test(0)) {
+    encoder.encodeClear("num:");
+  }
+  if (to._valid_.test(1)) {
+    if (!from._valid_.test(1) || from.txt_ != to.txt_) encoder.encode("txt:T", to.txt_);
+  } else if (from._valid_.test(1)) {
+    encoder.encodeClear("txt:");
+  }
+  if (to._valid_.test(2)) {
+    if (!from._valid_.test(2) || from.lnk_ != to.lnk_) encoder.encode("lnk:U", to.lnk_);
+  } else if (from._valid_.test(2)) {
+    encoder.encodeClear("lnk:");
+  }
+  if (to._valid_.test(3)) {
+    if (!from._valid_.test(3) || from.flg_ != to.flg_) encoder.encode("flg:B", to.flg_);
+  } else if (from._valid_.test(3)) {
+    encoder.encodeClear("flg:");
+  }
+}
+
+template<>
+inline void internal::Accessor::diff_entity(const Data& from, const Data& to, internal::BinaryEncoder& encoder) {
+  if (to._valid_.test(0)) {
+    if (!from._valid_.test(0) || from.num_ != to.num_) encoder.encode(0, to.num_);
+  } else if (from._valid_.test(0)) {
+    encoder.encodeClear(0);
+  }
+  if (to._valid_.test(1)) {
+    if (!from._valid_.test(1) || from.txt_ != to.txt_) encoder.encode(1, to.txt_);
+  } else if (from._valid_.test(1)) {
+    encoder.encodeClear(1);
+  }
+  if (to._valid_.test(2)) {
+    if (!from._valid_.test(2) || from.lnk_ != to.lnk_) encoder.encode(2, to.lnk_);
+  } else if (from._valid_.test(2)) {
+    encoder.encodeClear(2);
+  }
+  if (to._valid_.test(3)) {
+    if (!from._valid_.test(3) || from.flg_ != to.flg_) encoder.encode(3, to.flg_);
+  } else if (from._valid_.test(3)) {
+    encoder.encodeClear(3);
+  }
+}
+
+template<>
+inline void internal::Accessor::apply_patch(Data* entity, internal::StringDecoder& decoder) {
+  while (!decoder.done()) {
+    switch (Data::_field_index(decoder.upTo(':'))) {
+      case 0:
+        if (decoder.cleared()) {
+          entity->clear_num();
+        } else {
+          decoder.validate("N");
+          decoder.decode(entity->num_);
+          entity->_valid_.set(0);
+        }
+        break;
+      case 1:
+        if (decoder.cleared()) {
+          entity->clear_txt();
+        } else {
+          decoder.validate("T");
+          decoder.decode(entity->txt_);
+          entity->_valid_.set(1);
+        }
+        break;
+      case 2:
+        if (decoder.cleared()) {
+          entity->clear_lnk();
+        } else {
+          decoder.validate("U");
+          decoder.decode(entity->lnk_);
+          entity->_valid_.set(2);
+        }
+        break;
+      case 3:
+        if (decoder.cleared()) {
+          entity->clear_flg();
+        } else {
+          decoder.validate("B");
+          decoder.decode(entity->flg_);
+          entity->_valid_.set(3);
+        }
+        break;
+      default:
+        decoder.skip();
+    }
+    decoder.validate("|");
+  }
+}
+
+template<>
+inline void internal::Accessor::apply_patch(Data* entity, internal::BinaryDecoder& decoder) {
+  while (!decoder.done()) {
+    switch (decoder.field()) {
+      case 0:
+        if (decoder.cleared()) {
+          entity->clear_num();
+        } else {
+          decoder.decode(entity->num_);
+          entity->_valid_.set(0);
+        }
+        break;
+      case 1:
+        if (decoder.cleared()) {
+          entity->clear_txt();
+        } else {
+          decoder.decode(entity->txt_);
+          entity->_valid_.set(1);
+        }
+        break;
+      case 2:
+        if (decoder.cleared()) {
+          entity->clear_lnk();
+        } else {
+          decoder.decode(entity->lnk_);
+          entity->_valid_.set(2);
+        }
+        break;
+      case 3:
+        if (decoder.cleared()) {
+          entity->clear_flg();
+        } else {
+          decoder.decode(entity->flg_);
+          entity->_valid_.set(3);
+        }
+        break;
+      default:
+        decoder.skip();
+    }
+  }
 }
 
 }  // namespace arcs
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "src/wasm/cpp/kernels.h"
+
+// Clang defines __wasm_simd128__ when building with -msimd128.
+#ifndef ARCS_SIMD
+#ifdef __wasm_simd128__
+#define ARCS_SIMD 1
+#else
+#define ARCS_SIMD 0
+#endif
+#endif
+
+namespace arcs {
+namespace kernels {
+
+namespace {
+
+#if ARCS_SIMD
+// The generic vector extensions are lowered to SIMD128 instructions by the wasm backend.
+typedef double f64x2 __attribute__((vector_size(16)));
+typedef int64_t i64x2 __attribute__((vector_size(16)));
+typedef uint8_t u8x16 __attribute__((vector_size(16)));
+
+f64x2 load(const double* src) {
+  f64x2 v;
+  memcpy(&v, src, sizeof(v));
+  return v;
+}
+
+u8x16 load(const uint8_t* src) {
+  u8x16 v;
+  memcpy(&v, src, sizeof(v));
+  return v;
+}
+
+// Returns lane masks (all ones or all zeros) for rows i and i + 1 of the bitmap.
+i64x2 lanes(const internal::Bitmap& bits, size_t i) {
+  return i64x2{-int64_t(bits.test(i)), -int64_t(bits.test(i + 1))};
+}
+
+f64x2 select(i64x2 mask, f64x2 a, f64x2 b) {
+  return (f64x2)(((i64x2)a & mask) | ((i64x2)b & ~mask));
+}
+#endif
+
+// Returns a bitmap word for rows [start, end) with bits set where lo <= value < hi. Validity is
+// not checked.
+uint32_t range_bits(const double* values, size_t start, size_t end, double lo, double hi) {
+  uint32_t bits = 0;
+  size_t i = start;
+#if ARCS_SIMD
+  f64x2 vlo = {lo, lo};
+  f64x2 vhi = {hi, hi};
+  for (; i + 2 <= end; i += 2) {
+    f64x2 v = load(values + i);
+    i64x2 in = (i64x2)(v >= vlo) & (i64x2)(v < vhi);
+    bits |= uint32_t(in[0] & 1) << (i - start);
+    bits |= uint32_t(in[1] & 1) << (i - start + 1);
+  }
+#endif
+  for (; i < end; i++) {
+    bits |= uint32_t(lo <= values[i] && values[i] < hi) << (i - start);
+  }
+  return bits;
+}
+
+template<bool kMin>
+double better(double a, double b) {
+  return kMin ? std::min(a, b) : std::max(a, b);
+}
+
+template<bool kMin>
+bool extremum(const Column<double>& column, double* result) {
+  const internal::Bitmap& valid = column.valid();
+  if (valid.count() == 0) {
+    return false;
+  }
+  const double* values = column.data();
+  size_t n = column.size();
+  size_t i = 0;
+  double best = kMin ? INFINITY : -INFINITY;
+#if ARCS_SIMD
+  f64x2 acc = {best, best};
+  for (; i + 2 <= n; i += 2) {
+    // Unset rows are replaced by the current best, so they never win.
+    f64x2 v = select(lanes(valid, i), load(values + i), acc);
+    acc = select(kMin ? (i64x2)(v < acc) : (i64x2)(v > acc), v, acc);
+  }
+  best = better<kMin>(acc[0], acc[1]);
+#endif
+  for (; i < n; i++) {
+    if (valid.test(i)) {
+      best = better<kMin>(best, values[i]);
+    }
+  }
+  *result = best;
+  return true;
+}
+
+}  // namespace
+
+// Unset rows hold 0, so they can be summed along with everything else.
+double sum(const Column<double>& column) {
+  const double* values = column.data();
+  size_t n = column.size();
+  size_t i = 0;
+  double total = 0;
+#if ARCS_SIMD
+  f64x2 acc0 = {0, 0};
+  f64x2 acc1 = {0, 0};
+  for (; i + 4 <= n; i += 4) {
+    acc0 += load(values + i);
+    acc1 += load(values + i + 2);
+  }
+  f64x2 acc = acc0 + acc1;
+  total = acc[0] + acc[1];
+#endif
+  for (; i < n; i++) {
+    total += values[i];
+  }
+  return total;
+}
+
+double sum(const Column<double>& column, const internal::Bitmap& selection) {
+  const double* values = column.data();
+  size_t n = std::min(column.size(), selection.size());
+  size_t i = 0;
+  double total = 0;
+#if ARCS_SIMD
+  f64x2 acc = {0, 0};
+  f64x2 zero = {0, 0};
+  for (; i + 2 <= n; i += 2) {
+    acc += select(lanes(selection, i), load(values + i), zero);
+  }
+  total = acc[0] + acc[1];
+#endif
+  for (; i < n; i++) {
+    if (selection.test(i)) {
+      total += values[i];
+    }
+  }
+  return total;
+}
+
+bool min(const Column<double>& column, double* result) {
+  return extremum<true>(column, result);
+}
+
+bool max(const Column<double>& column, double* result) {
+  return extremum<false>(column, result);
+}
+
+// Values are stored as 0 or 1 and unset rows hold 0, so the true count is just the sum.
+size_t count(const Column<bool>& column, bool value) {
+  const uint8_t* values = column.data();
+  size_t n = column.size();
+  size_t i = 0;
+  size_t trues = 0;
+#if ARCS_SIMD
+  while (n - i >= 16) {
+    // Flush the byte lanes to the total before they can overflow.
+    size_t chunks = std::min<size_t>((n - i) / 16, 255);
+    u8x16 acc = {};
+    for (size_t c = 0; c < chunks; c++, i += 16) {
+      acc += load(values + i);
+    }
+    for (int lane = 0; lane < 16; lane++) {
+      trues += acc[lane];
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    trues += values[i];
+  }
+  return value ? trues : column.valid().count() - trues;
+}
+
+size_t count_in_range(const Column<double>& column, double lo, double hi) {
+  const std::vector<uint32_t>& valid = column.valid().words();
+  size_t n = column.size();
+  size_t total = 0;
+  for (size_t word = 0; word < valid.size(); word++) {
+    size_t start = word * 32;
+    uint32_t bits = range_bits(column.data(), start, std::min(n, start + 32), lo, hi);
+    total += __builtin_popcount(bits & valid[word]);
+  }
+  return total;
+}
+
+void filter_range(const Column<double>& column, double lo, double hi, internal::Bitmap* selection) {
+  const std::vector<uint32_t>& valid = column.valid().words();
+  size_t n = column.size();
+  selection->resize(n);
+  for (size_t word = 0; word < valid.size(); word++) {
+    size_t start = word * 32;
+    uint32_t bits = range_bits(column.data(), start, std::min(n, start + 32), lo, hi);
+    selection->set_word(word, bits & valid[word]);
+  }
+}
+
+void histogram(const Column<double>& column, double lo, double hi, std::vector<size_t>* bins) {
+  std::fill(bins->begin(), bins->end(), 0);
+  if (bins->empty() || !(lo < hi)) {
+    return;
+  }
+  const internal::Bitmap& valid = column.valid();
+  const double* values = column.data();
+  size_t n = column.size();
+  size_t i = 0;
+  size_t last = bins->size() - 1;
+  double scale = bins->size() / (hi - lo);
+#if ARCS_SIMD
+  f64x2 vlo = {lo, lo};
+  f64x2 vhi = {hi, hi};
+  f64x2 vscale = {scale, scale};
+  for (; i + 2 <= n; i += 2) {
+    f64x2 v = load(values + i);
+    i64x2 in = lanes(valid, i) & (i64x2)(v >= vlo) & (i64x2)(v < vhi);
+    f64x2 pos = (v - vlo) * vscale;
+    if (in[0]) (*bins)[std::min(size_t(pos[0]), last)]++;
+    if (in[1]) (*bins)[std::min(size_t(pos[1]), last)]++;
+  }
+#endif
+  for (; i < n; i++) {
+    double v = values[i];
+    if (valid.test(i) && lo <= v && v < hi) {
+      (*bins)[std::min(size_t((v - lo) * scale), last)]++;
+    }
+  }
+}
+
+}  // namespace kernels
+}  // namespace arcs
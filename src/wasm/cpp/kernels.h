@@ -0,0 +1,47 @@
+#ifndef _ARCS_KERNELS_H
+#define _ARCS_KERNELS_H
+
+#include <vector>
+#include "src/wasm/cpp/arcs.h"
+
+namespace arcs {
+
+// Aggregate and filter kernels over the columns of a Collection (see Collection::columns()).
+// Rows for which the field is not set are ignored throughout.
+//
+// When compiled with wasm SIMD support (copts = ["-msimd128"] on the cc_wasm_binary rule), these
+// process two Number values or sixteen Boolean values per instruction; otherwise they fall back
+// to plain scalar loops. Define ARCS_SIMD as 0 or 1 to override the choice. Sums may differ in
+// the last bits between the two versions, since the SIMD version adds the values in a different
+// order.
+namespace kernels {
+
+// Returns the sum of the set values (0 if there are none).
+double sum(const Column<double>& column);
+
+// Returns the sum of the set values at rows that are also set in the selection.
+double sum(const Column<double>& column, const internal::Bitmap& selection);
+
+// Store the smallest or largest set value in *result and return true, or return false if the
+// column has no set values.
+bool min(const Column<double>& column, double* result);
+bool max(const Column<double>& column, double* result);
+
+// Returns the number of rows set to the given value.
+size_t count(const Column<bool>& column, bool value);
+
+// Returns the number of set values with lo <= value < hi.
+size_t count_in_range(const Column<double>& column, double lo, double hi);
+
+// Resizes the selection to the column's size and sets exactly the bits for rows with
+// lo <= value < hi. The result can be passed to sum() or combined with other selections.
+void filter_range(const Column<double>& column, double lo, double hi, internal::Bitmap* selection);
+
+// Splits [lo, hi) into bins->size() equal-width bins and stores the number of set values that
+// fall in each; values outside the range are not counted.
+void histogram(const Column<double>& column, double lo, double hi, std::vector<size_t>* bins);
+
+}  // namespace kernels
+}  // namespace arcs
+
+#endif
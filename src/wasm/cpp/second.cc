@@ -13,7 +13,7 @@ public:
     serviceRequest("random.next", {}, "second");
   }
 
-  std::string getTemplate(const std::string& slot_name) override {
+  std::string_view getTemplateView(const std::string& slot_name) override {
     return R"(<h2>Classification with ML5 in WASM via C++</h2>
               <img style="max-width: 240px;" src="{{imageUrl}}"><br>
               <div>Label: <span>{{label}}</span></div>
@@ -0,0 +1,604 @@
+#include <algorithm>
+#include <vector>
+#include "src/wasm/cpp/tests/test-base.h"
+
+using arcs::internal::Accessor;
+
+static auto converter() {
+  return [](const arcs::Data& d) { return arcs::entity_to_str(d); };
+}
+
+// Builds a text-encoded list of entities (or of ids, for removals).
+static std::string encode_list(const std::vector<std::string>& items) {
+  std::string encoded = std::to_string(items.size()) + ":";
+  for (const std::string& item : items) {
+    encoded += std::to_string(item.size()) + ":" + item;
+  }
+  return encoded;
+}
+
+static std::string entity(const std::string& id, double num) {
+  arcs::Data d;
+  Accessor::set_id(&d, id);
+  d.set_num(num);
+  return Accessor::encode_entity(d);
+}
+
+static std::string text_entity(const std::string& id, const std::string& txt) {
+  arcs::Data d;
+  Accessor::set_id(&d, id);
+  d.set_txt(txt);
+  return Accessor::encode_entity(d);
+}
+
+static std::string entity(const std::string& id, double num, const std::string& txt) {
+  arcs::Data d;
+  Accessor::set_id(&d, id);
+  d.set_num(num);
+  d.set_txt(txt);
+  return Accessor::encode_entity(d);
+}
+
+static std::string id(const std::string& id) {
+  return std::to_string(id.size()) + ":" + id + "|";
+}
+
+
+class CollectionApiTest : public TestBase {
+public:
+  CollectionApiTest() {
+    registerHandle("col", col_);
+  }
+
+  void init() override {
+    RUN(test_sync);
+    RUN(test_update);
+    RUN(test_store_and_remove);
+    RUN(test_bulk_writes);
+    RUN(test_elided_writes);
+    RUN(test_many_entities);
+    RUN(test_recycle_on_sync);
+    RUN(test_columns);
+    RUN(test_find);
+    RUN(test_indexes);
+    RUN(test_views);
+    RUN(test_join);
+    // The listener added by this test stays registered, so it should run last.
+    RUN(test_update_listener);
+  }
+
+  void test_sync() {
+    std::vector<std::string> expected;
+    col_.sync(encode_list({entity("a", 1), entity("b", 2), entity("c", 3)}).c_str());
+    EQUAL(col_.size(), 3);
+    IS_FALSE(col_.empty());
+    expected = {"{a}, num: 1", "{b}, num: 2", "{c}, num: 3"};
+    CHECK_UNORDERED(col_, converter(), expected);
+
+    // Resyncing replaces the previous contents.
+    col_.sync(encode_list({entity("d", 4)}).c_str());
+    expected = {"{d}, num: 4"};
+    CHECK_UNORDERED(col_, converter(), expected);
+
+    col_.sync(encode_list({}).c_str());
+    IS_TRUE(col_.empty());
+    IS_TRUE(col_.begin() == col_.end());
+  }
+
+  void test_update() {
+    std::vector<std::string> expected;
+    col_.sync(encode_list({entity("a", 1), entity("b", 2), entity("c", 3)}).c_str());
+
+    // Existing entities are overwritten.
+    col_.update(encode_list({entity("b", 20), entity("e", 5)}).c_str(), encode_list({}).c_str());
+    expected = {"{a}, num: 1", "{b}, num: 20", "{c}, num: 3", "{e}, num: 5"};
+    CHECK_UNORDERED(col_, converter(), expected);
+
+    // Removing from the start, middle and end; unknown ids are ignored.
+    col_.update(encode_list({}).c_str(), encode_list({id("b"), id("x")}).c_str());
+    expected = {"{a}, num: 1", "{c}, num: 3", "{e}, num: 5"};
+    CHECK_UNORDERED(col_, converter(), expected);
+    col_.update(encode_list({}).c_str(), encode_list({id("a"), id("e")}).c_str());
+    expected = {"{c}, num: 3"};
+    CHECK_UNORDERED(col_, converter(), expected);
+
+    // Re-adding a removed id.
+    col_.update(encode_list({entity("a", 10)}).c_str(), encode_list({id("c")}).c_str());
+    expected = {"{a}, num: 10"};
+    CHECK_UNORDERED(col_, converter(), expected);
+  }
+
+  void test_store_and_remove() {
+    col_.sync(encode_list({entity("a", 1)}).c_str());
+
+    arcs::Data d1, d2;
+    d1.set_num(7);
+    d2.set_num(8);
+    col_.store(&d1);
+    col_.store(&d2);
+    EQUAL(col_.size(), 3);
+    NOT_EQUAL(Accessor::get_id(d1), "");
+
+    col_.remove(d1);
+    EQUAL(col_.size(), 2);
+    std::vector<double> nums;
+    for (const arcs::Data& d : col_) {
+      nums.push_back(d.num());
+    }
+    std::sort(nums.begin(), nums.end());
+    EQUAL(nums, std::vector<double>({1, 8}));
+
+    col_.remove("a");
+    EQUAL(col_.size(), 1);
+    IS_FALSE(col_.contains("a"));
+
+    // Unknown ids are sent to the host without being interned.
+    col_.remove("never-stored");
+    EQUAL(col_.size(), 1);
+    arcs::internal::Id unknown;
+    IS_FALSE(arcs::internal::Id::lookup("never-stored", &unknown));
+
+    col_.clear();
+    IS_TRUE(col_.empty());
+  }
+
+  void test_bulk_writes() {
+    auto nums = [](const arcs::Data& d) { return arcs::num_to_str(d.num()); };
+    col_.sync(encode_list({entity("a", 1), entity("b", 2)}).c_str());
+
+    arcs::Data d;
+    d.set_num(3);
+    col_.store(std::move(d));
+    std::vector<arcs::Data> added(2);
+    added[0].set_num(4);
+    added[1].set_num(5);
+    col_.storeAll(std::move(added));
+    IS_TRUE(added.empty());
+    std::vector<std::string> expected = {"1", "2", "3", "4", "5"};
+    CHECK_UNORDERED(col_, nums, expected);
+
+    col_.removeIds({"a", "missing"});
+    expected = {"2", "3", "4", "5"};
+    CHECK_UNORDERED(col_, nums, expected);
+
+    // "b" is unchanged, "c" is new and everything else is removed.
+    std::vector<arcs::Data> replacement(2);
+    Accessor::set_id(&replacement[0], "b");
+    replacement[0].set_num(2);
+    Accessor::set_id(&replacement[1], "c");
+    replacement[1].set_num(6);
+    col_.replaceAll(std::move(replacement));
+    expected = {"2", "6"};
+    CHECK_UNORDERED(col_, nums, expected);
+    IS_TRUE(col_.contains("c"));
+
+    col_.replaceAll({});
+    IS_TRUE(col_.empty());
+  }
+
+  void test_elided_writes() {
+    col_.sync(encode_list({entity("a", 1, "x")}).c_str());
+    col_.elideRedundantWrites();
+    size_t before = col_.elidedWrites();
+
+    arcs::Data d;
+    Accessor::set_id(&d, "a");
+    d.set_num(1);
+    d.set_txt("x");
+    col_.store(&d);
+    arcs::Data copy = arcs::clone_entity(d);
+    Accessor::set_id(&copy, "a");
+    col_.store(std::move(copy));
+    EQUAL(col_.elidedWrites(), before + 2);
+
+    d.set_num(2);
+    col_.store(&d);
+    EQUAL(col_.elidedWrites(), before + 2);
+    EQUAL(col_.find("a")->num(), 2);
+
+    // New entities always have to be written.
+    arcs::Data e = arcs::clone_entity(d);
+    col_.store(&e);
+    EQUAL(col_.size(), 2);
+
+    col_.elideRedundantWrites(false);
+    col_.store(&d);
+    EQUAL(col_.elidedWrites(), before + 2);
+    col_.clear();
+  }
+
+  void test_many_entities() {
+    std::vector<std::string> added;
+    for (int i = 0; i < 1000; i++) {
+      added.push_back(entity("id" + std::to_string(i), i));
+    }
+    col_.sync(encode_list(added).c_str());
+    EQUAL(col_.size(), 1000);
+
+    std::vector<std::string> removed;
+    for (int i = 1; i < 1000; i += 2) {
+      removed.push_back(id("id" + std::to_string(i)));
+    }
+    col_.update(encode_list({}).c_str(), encode_list(removed).c_str());
+    EQUAL(col_.size(), 500);
+
+    // Each remaining entity should be findable again after the swap-removals; overwriting them
+    // all must not change the size.
+    std::vector<std::string> updated;
+    for (int i = 0; i < 1000; i += 2) {
+      updated.push_back(entity("id" + std::to_string(i), -i));
+    }
+    col_.update(encode_list(updated).c_str(), encode_list({}).c_str());
+    EQUAL(col_.size(), 500);
+
+    bool ok = true;
+    for (const arcs::Data& d : col_) {
+      const std::string& id = Accessor::get_id(d);
+      ok = ok && std::stoi(id.substr(2)) % 2 == 0 && d.num() == -std::stoi(id.substr(2));
+    }
+    IS_TRUE(ok);
+  }
+
+  void test_recycle_on_sync() {
+    std::vector<std::string> expected;
+    col_.recycleOnSync();
+
+    std::string long1(100, 'a');
+    std::string long2(80, 'b');
+    col_.sync(encode_list({text_entity("x", long1), entity("y", 1), entity("z", 2)}).c_str());
+    EQUAL(col_.size(), 3);
+    const char* buffer = col_.begin()->txt().data();
+
+    // Resyncing reuses the first slot's string buffer, and drops fields that are no longer set.
+    col_.sync(encode_list({text_entity("w", long2), entity("y", 3)}).c_str());
+    EQUAL(col_.size(), 2);
+    EQUAL(col_.begin()->txt(), long2);
+    EQUAL(col_.begin()->txt().data(), buffer);
+    IS_FALSE(col_.begin()->has_num());
+    expected = {"{w}, txt: " + long2, "{y}, num: 3"};
+    CHECK_UNORDERED(col_, converter(), expected);
+
+    // Duplicate ids within a sync overwrite the earlier entry.
+    col_.sync(encode_list({entity("a", 1), entity("b", 2), entity("a", 3), entity("c", 4)}).c_str());
+    expected = {"{a}, num: 3", "{b}, num: 2", "{c}, num: 4"};
+    CHECK_UNORDERED(col_, converter(), expected);
+
+    // Updates still work against the recycled slots.
+    col_.update(encode_list({entity("d", 5)}).c_str(), encode_list({id("a")}).c_str());
+    expected = {"{b}, num: 2", "{c}, num: 4", "{d}, num: 5"};
+    CHECK_UNORDERED(col_, converter(), expected);
+
+    col_.sync(encode_list({}).c_str());
+    IS_TRUE(col_.empty());
+    col_.recycleOnSync(false);
+  }
+
+  // Checks that each row of the columns view matches the corresponding entity.
+  bool columns_match() {
+    const arcs::Columns<arcs::Data>& columns = col_.columns();
+    if (columns.size() != col_.size() || columns.num().size() != col_.size() ||
+        columns.flg().size() != col_.size()) {
+      return false;
+    }
+    size_t row = 0;
+    for (const arcs::Data& d : col_) {
+      if (columns.num().has(row) != d.has_num() || columns.num()[row] != d.num() ||
+          columns.flg().has(row) != d.has_flg() || columns.flg()[row] != d.flg()) {
+        return false;
+      }
+      row++;
+    }
+    return true;
+  }
+
+  void test_columns() {
+    col_.sync(encode_list({entity("a", 1), text_entity("b", "x"), entity("c", 3)}).c_str());
+    const arcs::Columns<arcs::Data>& columns = col_.columns();
+    IS_TRUE(columns_match());
+    EQUAL(columns.num().valid().count(), 2);
+    EQUAL(columns.flg().valid().count(), 0);
+
+    // Updates, overwrites and removals are reflected in the existing view.
+    arcs::Data d;
+    Accessor::set_id(&d, "d");
+    d.set_flg(true);
+    col_.update(encode_list({entity("b", 2), Accessor::encode_entity(d)}).c_str(),
+                encode_list({id("a")}).c_str());
+    IS_TRUE(columns_match());
+    EQUAL(columns.num().valid().count(), 2);
+    EQUAL(columns.flg().valid().count(), 1);
+
+    double sum = 0;
+    for (size_t i = 0; i < columns.size(); i++) {
+      sum += columns.num().data()[i];
+    }
+    EQUAL(sum, 5);
+
+    // Large enough to span several bitmap words, then shrunk back down.
+    std::vector<std::string> added;
+    for (int i = 0; i < 100; i++) {
+      added.push_back(entity("id" + std::to_string(i), i));
+    }
+    col_.update(encode_list(added).c_str(), encode_list({}).c_str());
+    IS_TRUE(columns_match());
+    EQUAL(columns.num().valid().count(), 102);
+
+    col_.recycleOnSync();
+    col_.sync(encode_list({text_entity("e", "y"), entity("f", 6)}).c_str());
+    IS_TRUE(columns_match());
+    EQUAL(columns.num().valid().count(), 1);
+    col_.recycleOnSync(false);
+
+    col_.sync(encode_list({}).c_str());
+    EQUAL(columns.size(), 0);
+    EQUAL(columns.num().valid().count(), 0);
+  }
+
+  void test_find() {
+    col_.sync(encode_list({entity("a", 1), entity("b", 2)}).c_str());
+    const arcs::Data* d = col_.find("b");
+    IS_TRUE(d != nullptr);
+    EQUAL(d->num(), 2);
+    IS_TRUE(col_.contains("a"));
+    IS_FALSE(col_.contains("c"));
+    IS_FALSE(col_.contains(""));
+
+    // An id that is interned elsewhere but not present in the collection.
+    arcs::Data other;
+    Accessor::set_id(&other, "elsewhere");
+    IS_FALSE(col_.contains("elsewhere"));
+
+    col_.update(encode_list({}).c_str(), encode_list({id("a")}).c_str());
+    IS_FALSE(col_.contains("a"));
+    EQUAL(col_.find("b")->num(), 2);
+  }
+
+  // Returns the ids of the given entities, sorted when requested.
+  static std::vector<std::string> ids(const std::vector<const arcs::Data*>& entities, bool sort) {
+    std::vector<std::string> res;
+    for (const arcs::Data* d : entities) {
+      res.push_back(Accessor::get_id(*d));
+    }
+    if (sort) {
+      std::sort(res.begin(), res.end());
+    }
+    return res;
+  }
+
+  void test_indexes() {
+    // Use a local handle so the indexes don't outlive this test.
+    arcs::Collection<arcs::Data> col;
+    col.sync(encode_list({entity("a", 5, "x"), entity("b", 3, "y"), text_entity("c", "x")}).c_str());
+
+    // Indexes added to a populated collection include the existing entities.
+    const auto& by_txt = col.addHashIndex(&arcs::Data::txt, &arcs::Data::has_txt);
+    const auto& by_num = col.addOrderedIndex(&arcs::Data::num, &arcs::Data::has_num);
+    EQUAL(by_txt.count("x"), 2);
+    EQUAL(ids(by_txt.find("x"), true), std::vector<std::string>({"a", "c"}));
+    EQUAL(by_txt.find("z").size(), 0);
+    EQUAL(by_num.size(), 2);
+
+    // Updates and removals, including swap-removal moving entities between slots.
+    col.update(encode_list({entity("d", 9, "y"), entity("e", 1, "z"), entity("b", 4, "x")}).c_str(),
+               encode_list({id("a")}).c_str());
+    EQUAL(ids(by_txt.find("x"), true), std::vector<std::string>({"b", "c"}));
+    EQUAL(ids(by_txt.find("y"), true), std::vector<std::string>({"d"}));
+    EQUAL(ids(by_num.range(1, 9), false), std::vector<std::string>({"e", "b"}));
+    EQUAL(ids(by_num.top(2), false), std::vector<std::string>({"d", "b"}));
+    EQUAL(ids(by_num.bottom(1), false), std::vector<std::string>({"e"}));
+
+    // Entries must still point at the right entities after further removals.
+    col.update(encode_list({}).c_str(), encode_list({id("b"), id("c")}).c_str());
+    EQUAL(by_txt.count("x"), 0);
+    EQUAL(ids(by_num.top(5), false), std::vector<std::string>({"d", "e"}));
+
+    col.recycleOnSync();
+    col.sync(encode_list({entity("f", 2, "x"), entity("g", 7, "x")}).c_str());
+    EQUAL(ids(by_txt.find("x"), true), std::vector<std::string>({"f", "g"}));
+    EQUAL(ids(by_num.top(5), false), std::vector<std::string>({"g", "f"}));
+
+    col.sync(encode_list({}).c_str());
+    EQUAL(by_txt.count("x"), 0);
+    EQUAL(by_num.size(), 0);
+  }
+
+  // Formats the rows of a materialized view as sorted "key=value" strings.
+  template<typename V>
+  static std::vector<std::string> rows(const arcs::MaterializedView<std::string, V>& view) {
+    std::vector<std::string> res;
+    for (const auto& row : view) {
+      res.push_back(row.first + "=" + arcs::num_to_str(row.second));
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+  }
+
+  void test_views() {
+    // Use a local source handle so the views don't outlive this test.
+    arcs::Collection<arcs::Data> source;
+    arcs::CollectionView<arcs::Data> view(source);
+    auto txt = [](const arcs::Data& d) { return d.txt(); };
+    auto num = [](const arcs::Data& d) { return d.num(); };
+    auto& big = view.filter([](const arcs::Data& d) { return d.num() >= 10; });
+
+    const auto& counts = view.groupCount(txt).materialize();
+    const auto& sums = view.groupSum(txt, num).materialize();
+    const auto& distinct = view.distinct(txt).materialize();
+    const auto& big_nums = big.map(num).materialize();
+    const auto& big_counts = big.groupCount(txt).materialize();
+
+    // Derived entities are mirrored into col_.
+    col_.sync(encode_list({}).c_str());
+    big.map([](const arcs::Data& d) {
+      arcs::Data out;
+      out.set_txt(d.txt());
+      out.set_num(d.num() * 2);
+      return out;
+    }).bindTo(col_);
+    auto fields = [](const arcs::Data& d) { return d.txt() + "=" + arcs::num_to_str(d.num()); };
+
+    source.sync(encode_list({entity("a", 1, "x"), entity("b", 10, "y"), entity("c", 20, "x")}).c_str());
+    EQUAL(rows(counts), std::vector<std::string>({"x=2", "y=1"}));
+    EQUAL(rows(sums), std::vector<std::string>({"x=21", "y=10"}));
+    EQUAL(distinct.size(), 2);
+    IS_TRUE(distinct.find("x") != nullptr);
+    EQUAL(big_nums.size(), 2);
+    EQUAL(rows(big_counts), std::vector<std::string>({"x=1", "y=1"}));
+    std::vector<std::string> expected = {"x=40", "y=20"};
+    CHECK_UNORDERED(col_, fields, expected);
+    std::string y20_id;
+    for (const arcs::Data& d : col_) {
+      if (d.num() == 20) y20_id = Accessor::get_id(d);
+    }
+
+    // Moving "a" between groups, removing "c" and adding "d".
+    source.update(encode_list({entity("a", 30, "y"), entity("d", 5, "z")}).c_str(),
+                  encode_list({id("c")}).c_str());
+    EQUAL(rows(counts), std::vector<std::string>({"y=2", "z=1"}));
+    EQUAL(rows(sums), std::vector<std::string>({"y=40", "z=5"}));
+    EQUAL(distinct.size(), 2);
+    IS_TRUE(distinct.find("x") == nullptr);
+    IS_TRUE(distinct.find("z") != nullptr);
+    double total = 0;
+    for (const auto& row : big_nums) {
+      total += row.second;
+    }
+    EQUAL(total, 40);
+    EQUAL(rows(big_counts), std::vector<std::string>({"y=2"}));
+    expected = {"y=20", "y=60"};
+    CHECK_UNORDERED(col_, fields, expected);
+
+    // Unchanged rows keep their stored entities, both across updates and resyncs.
+    source.sync(encode_list({entity("a", 30, "y"), entity("b", 10, "y")}).c_str());
+    CHECK_UNORDERED(col_, fields, expected);
+    for (const arcs::Data& d : col_) {
+      if (d.num() == 20) EQUAL(Accessor::get_id(d), y20_id);
+    }
+    EQUAL(rows(counts), std::vector<std::string>({"y=2"}));
+
+    source.sync(encode_list({}).c_str());
+    IS_TRUE(counts.empty());
+    IS_TRUE(col_.empty());
+  }
+
+  // Formats the rows of a join as sorted "left/right" id pairs, with "-" for unmatched rows.
+  template<typename J>
+  static std::vector<std::string> pairs(const J& join) {
+    std::vector<std::string> res;
+    join.forEach([&res](const arcs::Data& left, const arcs::Data* right) {
+      res.push_back(Accessor::get_id(left) + "/" + (right ? Accessor::get_id(*right) : "-"));
+    });
+    std::sort(res.begin(), res.end());
+    return res;
+  }
+
+  void test_join() {
+    arcs::Collection<arcs::Data> left;
+    arcs::Collection<arcs::Data> right;
+    auto txt = [](const arcs::Data& d) { return d.txt(); };
+    arcs::Join<arcs::Data, arcs::Data, std::string> inner(left, right, txt, txt);
+    arcs::Join<arcs::Data, arcs::Data, std::string> outer(left, right, txt, txt, arcs::JoinType::Left);
+    const auto& sums = outer.map([](const arcs::JoinRow<arcs::Data, arcs::Data>& row) {
+      return row.left->num() + (row.right ? row.right->num() : 0);
+    }).materialize();
+    auto total = [&sums] {
+      double total = 0;
+      for (const auto& row : sums) {
+        total += row.second;
+      }
+      return total;
+    };
+
+    left.sync(encode_list({entity("a", 1, "x"), entity("b", 2, "y"), entity("c", 3, "z")}).c_str());
+    right.sync(encode_list({entity("p", 10, "x"), entity("q", 20, "x"), entity("r", 30, "y")}).c_str());
+    EQUAL(pairs(inner), std::vector<std::string>({"a/p", "a/q", "b/r"}));
+    EQUAL(pairs(outer), std::vector<std::string>({"a/p", "a/q", "b/r", "c/-"}));
+    EQUAL(inner.size(), 3);
+    EQUAL(outer.size(), 4);
+    EQUAL(sums.size(), 4);
+    EQUAL(total(), 11 + 21 + 32 + 3);
+
+    // The first match for "z" replaces c's unmatched row; "b" loses its only match.
+    right.update(encode_list({entity("s", 40, "z")}).c_str(), encode_list({id("r")}).c_str());
+    EQUAL(pairs(inner), std::vector<std::string>({"a/p", "a/q", "c/s"}));
+    EQUAL(pairs(outer), std::vector<std::string>({"a/p", "a/q", "b/-", "c/s"}));
+    EQUAL(total(), 11 + 21 + 2 + 43);
+
+    // Changing join keys on either side moves entities between groups.
+    left.update(encode_list({entity("a", 5, "z"), entity("d", 4, "w")}).c_str(), encode_list({}).c_str());
+    right.update(encode_list({entity("q", 50, "y")}).c_str(), encode_list({}).c_str());
+    EQUAL(pairs(inner), std::vector<std::string>({"a/s", "b/q", "c/s"}));
+    EQUAL(pairs(outer), std::vector<std::string>({"a/s", "b/q", "c/s", "d/-"}));
+    EQUAL(total(), 45 + 52 + 43 + 4);
+
+    left.update(encode_list({}).c_str(), encode_list({id("c"), id("d")}).c_str());
+    EQUAL(pairs(outer), std::vector<std::string>({"a/s", "b/q"}));
+    EQUAL(sums.size(), 2);
+
+    right.sync(encode_list({}).c_str());
+    EQUAL(inner.size(), 0);
+    EQUAL(pairs(outer), std::vector<std::string>({"a/-", "b/-"}));
+    EQUAL(total(), 5 + 2);
+  }
+
+  void test_update_listener() {
+    std::vector<std::string> expected;
+    col_.sync(encode_list({entity("a", 1), entity("b", 2), entity("c", 3)}).c_str());
+
+    col_.onUpdate([this](const arcs::CollectionDelta<arcs::Data>& delta) {
+      calls_++;
+      for (const arcs::Data* d : delta.added) {
+        log_.push_back("+" + arcs::entity_to_str(*d));
+      }
+      for (const arcs::Data* d : delta.changed) {
+        log_.push_back("*" + arcs::entity_to_str(*d));
+      }
+      for (const arcs::Data& d : delta.removed) {
+        log_.push_back("-" + arcs::entity_to_str(d));
+      }
+    });
+
+    // Syncs are not reported.
+    col_.sync(encode_list({entity("a", 1), entity("b", 2), entity("c", 3)}).c_str());
+    EQUAL(calls_, 0);
+
+    // Removing "a" moves the last entity into its slot; the added and changed pointers must
+    // still refer to the right entities.
+    col_.update(encode_list({entity("b", 20), entity("c", 3), entity("d", 4)}).c_str(),
+                encode_list({id("a"), id("x")}).c_str());
+    EQUAL(calls_, 1);
+    expected = {"*{b}, num: 20", "+{d}, num: 4", "-{a}, num: 1"};
+    CHECK_UNORDERED(log_, [](const std::string& s) { return s; }, expected);
+
+    // Updates with no effective changes don't call the listener.
+    log_.clear();
+    col_.update(encode_list({entity("c", 3)}).c_str(), encode_list({id("a")}).c_str());
+    EQUAL(calls_, 1);
+
+    // Local writes are reported, and the runtime's echo of them is not.
+    arcs::Data d;
+    d.set_num(5);
+    col_.store(&d);
+    EQUAL(calls_, 2);
+    std::string stored = arcs::entity_to_str(d);
+    expected = {"+" + stored};
+    CHECK_UNORDERED(log_, [](const std::string& s) { return s; }, expected);
+    col_.update(encode_list({Accessor::encode_entity(d)}).c_str(), encode_list({}).c_str());
+    EQUAL(calls_, 2);
+
+    log_.clear();
+    col_.clear();
+    EQUAL(calls_, 3);
+    expected = {"-{b}, num: 20", "-{c}, num: 3", "-{d}, num: 4", "-" + stored};
+    std::sort(expected.begin(), expected.end());
+    CHECK_UNORDERED(log_, [](const std::string& s) { return s; }, expected);
+  }
+
+  arcs::Collection<arcs::Data> col_;
+
+  // Written by the update listener in test_update_listener.
+  std::vector<std::string> log_;
+  int calls_ = 0;
+};
+
+DEFINE_PARTICLE(CollectionApiTest)
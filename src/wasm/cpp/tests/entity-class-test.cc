@@ -24,6 +24,7 @@ public:
   void init() override {
     RUN(test_field_methods);
     RUN(test_id_equality);
+    RUN(test_interned_ids);
     RUN(test_number_field_equality);
     RUN(test_text_field_equality);
     RUN(test_url_field_equality);
@@ -32,10 +33,14 @@ public:
     RUN(test_entity_equality);
     RUN(test_clone_entity);
     RUN(test_entity_to_str);
+    RUN(test_wire_formats);
+    RUN(test_encoded_size);
+    RUN(test_patches);
     RUN(test_stl_vector);
     RUN(test_stl_set);
     RUN(test_stl_unordered_set);
     RUN(test_empty_schema);
+    RUN(test_field_mask);
   }
 
   void test_field_methods() {
@@ -122,6 +127,32 @@ public:
     NOT_LESS(d2, d1);
   }
 
+  void test_interned_ids() {
+    arcs::Data d1, d2, d3;
+    Accessor::set_id(&d1, "shared");
+    Accessor::set_id(&d2, std::string("shar") + "ed");
+    Accessor::set_id(&d3, "other");
+
+    // Equal ids share the same interned text.
+    EQUAL(&Accessor::get_id(d1), &Accessor::get_id(d2));
+    NOT_EQUAL(&Accessor::get_id(d1), &Accessor::get_id(d3));
+    EQUAL(d1, d2);
+    EQUAL(hash(d1), hash(d2));
+
+    // Ids survive the entities they were copied from and are released with the last user.
+    arcs::Data d4;
+    {
+      arcs::Data tmp;
+      Accessor::set_id(&tmp, "transient");
+      d4 = std::move(tmp);
+    }
+    EQUAL(Accessor::get_id(d4), "transient");
+    Accessor::set_id(&d4, "");
+    EQUAL(Accessor::get_id(d4), "");
+    Accessor::set_id(&d4, "transient");
+    EQUAL(Accessor::get_id(d4), "transient");
+  }
+
   void test_number_field_equality() {
     arcs::Data d1, d2;
 
@@ -448,6 +479,162 @@ public:
     EQUAL(arcs::entity_to_str(d), "{id}, num: 6, txt: boo, ref: REF<i12|k34>");
   }
 
+  void test_wire_formats() {
+    arcs::Data src;
+    Accessor::set_id(&src, "id");
+    src.set_num(-7.25);
+    src.set_txt("a|b:c");
+    src.set_flg(false);
+
+    std::string text = Accessor::encode_entity(src, arcs::internal::WireFormat::Text);
+    EQUAL(text, "2:id|num:N-7.25:|txt:T5:a|b:c|flg:B0|");
+    std::string binary = Accessor::encode_entity(src, arcs::internal::WireFormat::Binary);
+    EQUAL(binary[0], arcs::internal::kBinaryMarker);
+    LESS(binary.size(), text.size());
+
+    for (const std::string& encoded : {text, binary}) {
+      arcs::Data d;
+      Accessor::decode_entity(&d, encoded.c_str());
+      EQUAL(d, src);
+      IS_FALSE(d.has_lnk());
+    }
+
+    // Unknown fields in the binary format are skipped.
+    arcs::internal::BinaryEncoder encoder;
+    encoder.encodeString("id");
+    encoder.encode(17, std::string("future text field"));
+    encoder.encode(1, std::string("abc"));
+    encoder.encode(18, 3.5);
+    encoder.encode(19, true);
+    std::string extended = encoder.result();
+
+    arcs::Data d;
+    Accessor::decode_entity(&d, extended.c_str());
+    EQUAL(arcs::entity_to_str(d), "{id}, txt: abc");
+
+    // As are unknown fields in the text format.
+    arcs::Data d2;
+    Accessor::decode_entity(&d2, "2:id|zz:T4:a|b:|num:N2:|tx:N-1e3:|nums:B1|flg:B1|lnkx:U0:|");
+    EQUAL(arcs::entity_to_str(d2), "{id}, num: 2, flg: true");
+
+    // Text decoding is bounded by the view it is given, not the underlying buffer.
+    std::string list = "2:" + std::to_string(text.size()) + ":" + text + "13:2:xy|num:N9:|";
+    std::vector<arcs::Data> decoded;
+    arcs::internal::StringDecoder::decodeList(list.c_str(), [&decoded](std::string_view chunk) {
+      decoded.emplace_back();
+      arcs::internal::StringDecoder decoder(chunk);
+      Accessor::decode_entity(&decoded.back(), decoder);
+    });
+    EQUAL(decoded.size(), 2);
+    EQUAL(decoded[0], src);
+    EQUAL(arcs::entity_to_str(decoded[1]), "{xy}, num: 9");
+
+    // Reference fields are nested within the field value in both formats.
+    arcs::Data with_ref = arcs::clone_entity(src);
+    Accessor::copy_id(&with_ref, src);
+    with_ref.set_ref(make_ref("r1", "k:1|"));
+    text = Accessor::encode_entity(with_ref, arcs::internal::WireFormat::Text);
+    EQUAL(text, "2:id|num:N-7.25:|txt:T5:a|b:c|flg:B0|ref:R12:2:r1|4:k:1|||");
+    binary = Accessor::encode_entity(with_ref, arcs::internal::WireFormat::Binary);
+    for (const std::string& encoded : {text, binary}) {
+      arcs::Data d;
+      Accessor::decode_entity(&d, encoded.c_str());
+      EQUAL(d, with_ref);
+      EQUAL(d.ref(), make_ref("r1", "k:1|"));
+    }
+  }
+
+  void test_encoded_size() {
+    arcs::Data d1, d2, d3;
+    Accessor::set_id(&d2, "id");
+    d2.set_num(0.5);
+    d2.set_flg(true);
+    Accessor::set_id(&d3, std::string(200, 'x'));
+    d3.set_num(-1e300);
+    d3.set_txt(std::string(1000, 't'));
+    d3.set_lnk("");
+    d3.set_flg(false);
+    d3.set_ref(make_ref(std::string(150, 'r'), "key"));
+
+    // Numbers are not formatted when computing the text size, so it is only an upper bound.
+    for (const arcs::Data* d : {&d1, &d2, &d3}) {
+      arcs::internal::StringEncoder text_encoder;
+      size_t text_size = Accessor::encoded_size(*d, text_encoder);
+      size_t text_len = Accessor::encode_entity(*d, arcs::internal::WireFormat::Text).size();
+      NOT_LESS(text_size, text_len);
+      LESS(text_size, text_len + 20);
+
+      arcs::internal::BinaryEncoder binary_encoder;
+      size_t binary_size = Accessor::encoded_size(*d, binary_encoder) + arcs::internal::kBinaryHeaderSize;
+      EQUAL(binary_size, Accessor::encode_entity(*d, arcs::internal::WireFormat::Binary).size());
+    }
+  }
+
+  void test_patches() {
+    arcs::Data from;
+    Accessor::set_id(&from, "id");
+    from.set_num(3);
+    from.set_txt("abc");
+    from.set_flg(true);
+
+    arcs::Data to = arcs::clone_entity(from);
+    Accessor::set_id(&to, "id");
+    to.set_txt("xyz");
+    to.set_lnk("http://l");
+    to.clear_flg();
+
+    // Only changed fields are included, and cleared fields are marked.
+    std::string text = Accessor::diff_entity(from, to, arcs::internal::WireFormat::Text);
+    EQUAL(text, "P2:id|txt:T3:xyz|lnk:U8:http://l|flg:-|");
+    std::string binary = Accessor::diff_entity(from, to, arcs::internal::WireFormat::Binary);
+    EQUAL(binary[0], arcs::internal::kBinaryPatchMarker);
+    EQUAL(Accessor::diff_entity(to, to), "P2:id|");
+
+    for (const std::string& encoded : {text, binary}) {
+      IS_TRUE(Accessor::is_patch(encoded.c_str()));
+      arcs::Data d = arcs::clone_entity(from);
+      Accessor::set_id(&d, "id");
+      IS_TRUE(Accessor::apply_patch(&d, encoded.c_str()));
+      EQUAL(d, to);
+    }
+
+    // Reference fields are patched like any other.
+    arcs::Data to_ref = arcs::clone_entity(to);
+    Accessor::set_id(&to_ref, "id");
+    to_ref.set_ref(make_ref("r", "k"));
+    for (auto format : {arcs::internal::WireFormat::Text, arcs::internal::WireFormat::Binary}) {
+      arcs::Data d = arcs::clone_entity(to);
+      Accessor::set_id(&d, "id");
+      IS_TRUE(Accessor::apply_patch(&d, Accessor::diff_entity(to, to_ref, format).c_str()));
+      EQUAL(d.ref(), make_ref("r", "k"));
+    }
+
+    // Patches are only applied to the entity they were made for.
+    arcs::Data other = arcs::clone_entity(from);
+    Accessor::set_id(&other, "other");
+    IS_FALSE(Accessor::apply_patch(&other, text.c_str()));
+    IS_FALSE(Accessor::apply_patch(&other, binary.c_str()));
+    EQUAL(other.txt(), "abc");
+    IS_FALSE(Accessor::is_patch(Accessor::encode_entity(other).c_str()));
+    IS_FALSE(Accessor::apply_patch(&other, Accessor::encode_entity(other).c_str()));
+
+    // Unknown fields are skipped, whether set or cleared.
+    arcs::Data d;
+    Accessor::set_id(&d, "id");
+    IS_TRUE(Accessor::apply_patch(&d, "P2:id|zz:-|num:N4:|yy:T1:a|"));
+    EQUAL(arcs::entity_to_str(d), "{id}, num: 4");
+
+    arcs::internal::BinaryEncoder encoder(arcs::internal::kBinaryPatchMarker);
+    encoder.encodeString("id");
+    encoder.encodeClear(17);
+    encoder.encodeClear(0);
+    encoder.encode(18, std::string("future text field"));
+    encoder.encode(3, false);
+    std::string extended = encoder.result();
+    IS_TRUE(Accessor::apply_patch(&d, extended.c_str()));
+    EQUAL(arcs::entity_to_str(d), "{id}, flg: false");
+  }
+
   void test_stl_vector() {
     arcs::Data d1, d2, d3;
     d1.set_num(12);
@@ -593,6 +780,43 @@ public:
     s2.insert(std::move(e4));
     CHECK_UNORDERED(s2, converter, expected);
   }
+
+  void test_field_mask() {
+    // Narrow schemas pack their validity bits into a single byte.
+    EQUAL(sizeof(arcs::internal::FieldMask<0>), 1);
+    EQUAL(sizeof(arcs::internal::FieldMask<8>), 1);
+    EQUAL(sizeof(arcs::internal::FieldMask<9>), 2);
+    EQUAL(sizeof(arcs::internal::FieldMask<33>), 8);
+
+    arcs::internal::FieldMask<40> m1, m2;
+    IS_TRUE(m1 == m2);
+    m1.set(0);
+    m1.set(31);
+    m1.set(39);
+    IS_TRUE(m1.test(0));
+    IS_FALSE(m1.test(1));
+    IS_TRUE(m1.test(31));
+    IS_FALSE(m1.test(32));
+    IS_TRUE(m1.test(39));
+    IS_TRUE(m1 != m2);
+    m1.reset(31);
+    IS_FALSE(m1.test(31));
+    IS_TRUE(m1.test(39));
+    m1.clear();
+    IS_TRUE(m1 == m2);
+
+    // Field bits follow schema order, independently of the member layout.
+    arcs::Data d;
+    d.set_flg(false);
+    d.set_num(0);
+    IS_TRUE(d.has_flg());
+    IS_TRUE(d.has_num());
+    IS_FALSE(d.has_txt());
+    IS_FALSE(d.has_lnk());
+    d.clear_num();
+    IS_FALSE(d.has_num());
+    IS_TRUE(d.has_flg());
+  }
 };
 
 DEFINE_PARTICLE(EntityClassApiTest)
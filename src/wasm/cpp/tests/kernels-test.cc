@@ -0,0 +1,152 @@
+#include <cmath>
+#include <vector>
+#include "src/wasm/cpp/kernels.h"
+#include "src/wasm/cpp/tests/test-base.h"
+
+using arcs::internal::Accessor;
+
+// Builds a text-encoded list of entities with the given num values; NaN leaves num unset, and
+// every third entity has flg set to true.
+static std::string encode_nums(const std::vector<double>& nums) {
+  std::string encoded = std::to_string(nums.size()) + ":";
+  for (size_t i = 0; i < nums.size(); i++) {
+    arcs::Data d;
+    Accessor::set_id(&d, "id" + std::to_string(i));
+    if (nums[i] == nums[i]) {
+      d.set_num(nums[i]);
+    }
+    d.set_flg(i % 3 == 0);
+    std::string item = Accessor::encode_entity(d);
+    encoded += std::to_string(item.size()) + ":" + item;
+  }
+  return encoded;
+}
+
+
+class KernelsTest : public TestBase {
+public:
+  KernelsTest() {
+    registerHandle("col", col_);
+  }
+
+  void init() override {
+    RUN(test_empty);
+    RUN(test_sum);
+    RUN(test_min_max);
+    RUN(test_count);
+    RUN(test_range_filter);
+    RUN(test_histogram);
+  }
+
+  // Values 0..n-1, with every fifth one unset. Sizes are chosen to exercise partial SIMD lanes
+  // and bitmap words.
+  std::vector<double> sample(int n) {
+    std::vector<double> nums;
+    for (int i = 0; i < n; i++) {
+      nums.push_back(i % 5 == 4 ? NAN : i);
+    }
+    return nums;
+  }
+
+  void test_empty() {
+    col_.sync(encode_nums({}).c_str());
+    const arcs::Columns<arcs::Data>& columns = col_.columns();
+    double result = 0;
+    EQUAL(arcs::kernels::sum(columns.num()), 0);
+    IS_FALSE(arcs::kernels::min(columns.num(), &result));
+    IS_FALSE(arcs::kernels::max(columns.num(), &result));
+    EQUAL(arcs::kernels::count(columns.flg(), true), 0);
+    EQUAL(arcs::kernels::count_in_range(columns.num(), 0, 10), 0);
+  }
+
+  void test_sum() {
+    for (int n : {1, 3, 4, 37, 100}) {
+      col_.sync(encode_nums(sample(n)).c_str());
+      double expected = 0;
+      for (const arcs::Data& d : col_) {
+        expected += d.num();
+      }
+      EQUAL(arcs::kernels::sum(col_.columns().num()), expected);
+    }
+
+    arcs::internal::Bitmap selection;
+    arcs::kernels::filter_range(col_.columns().num(), 10, 20, &selection);
+    // 10..19 without 14 and 19.
+    EQUAL(arcs::kernels::sum(col_.columns().num(), selection), 10 + 11 + 12 + 13 + 15 + 16 + 17 + 18);
+  }
+
+  void test_min_max() {
+    double result = 0;
+    col_.sync(encode_nums({NAN, 5, -2.5, NAN, 7, 3}).c_str());
+    IS_TRUE(arcs::kernels::min(col_.columns().num(), &result));
+    EQUAL(result, -2.5);
+    IS_TRUE(arcs::kernels::max(col_.columns().num(), &result));
+    EQUAL(result, 7);
+
+    // Unset rows hold 0 internally, which must not be reported.
+    col_.sync(encode_nums({4, NAN, 9, NAN, 6}).c_str());
+    IS_TRUE(arcs::kernels::min(col_.columns().num(), &result));
+    EQUAL(result, 4);
+    col_.sync(encode_nums({-4, NAN, -9}).c_str());
+    IS_TRUE(arcs::kernels::max(col_.columns().num(), &result));
+    EQUAL(result, -4);
+
+    col_.sync(encode_nums({NAN, NAN, NAN}).c_str());
+    IS_FALSE(arcs::kernels::min(col_.columns().num(), &result));
+  }
+
+  void test_count() {
+    col_.sync(encode_nums(sample(1000)).c_str());
+    EQUAL(arcs::kernels::count(col_.columns().flg(), true), 334);
+    EQUAL(arcs::kernels::count(col_.columns().flg(), false), 666);
+
+    // Rows without flg set are not counted as false.
+    arcs::Data d;
+    Accessor::set_id(&d, "unset");
+    std::string item = Accessor::encode_entity(d);
+    col_.update(("1:" + std::to_string(item.size()) + ":" + item).c_str(), "0:");
+    EQUAL(arcs::kernels::count(col_.columns().flg(), true), 334);
+    EQUAL(arcs::kernels::count(col_.columns().flg(), false), 666);
+  }
+
+  void test_range_filter() {
+    col_.sync(encode_nums(sample(70)).c_str());
+    const arcs::Column<double>& num = col_.columns().num();
+
+    // Unset rows hold 0 but must not match a range that includes 0.
+    EQUAL(arcs::kernels::count_in_range(num, -1, 1), 1);
+    EQUAL(arcs::kernels::count_in_range(num, 30, 40), 8);
+    EQUAL(arcs::kernels::count_in_range(num, 40, 30), 0);
+
+    arcs::internal::Bitmap selection;
+    arcs::kernels::filter_range(num, 30, 40, &selection);
+    EQUAL(selection.size(), 70);
+    EQUAL(selection.count(), 8);
+    bool ok = true;
+    for (size_t row = 0; row < num.size(); row++) {
+      bool expected = num.has(row) && num[row] >= 30 && num[row] < 40;
+      ok = ok && selection.test(row) == expected;
+    }
+    IS_TRUE(ok);
+
+    // Reusing a larger selection leaves no stale bits behind.
+    col_.sync(encode_nums(sample(10)).c_str());
+    arcs::kernels::filter_range(col_.columns().num(), 0, 100, &selection);
+    EQUAL(selection.size(), 10);
+    EQUAL(selection.count(), 8);
+  }
+
+  void test_histogram() {
+    col_.sync(encode_nums(sample(50)).c_str());
+    std::vector<size_t> bins(4, 99);
+    arcs::kernels::histogram(col_.columns().num(), 0, 40, &bins);
+    EQUAL(bins, std::vector<size_t>({8, 8, 8, 8}));
+
+    arcs::kernels::histogram(col_.columns().num(), 45, 46, &bins);
+    EQUAL(bins, std::vector<size_t>({1, 0, 0, 0}));
+  }
+
+  arcs::Collection<arcs::Data> col_;
+};
+
+DEFINE_PARTICLE(KernelsTest)
@@ -41,7 +41,7 @@ public:
     registerHandle("flags", flags_);
   }
 
-  std::string getTemplate(const std::string& slot_name) override {
+  std::string_view getTemplateView(const std::string& slot_name) override {
     return "abc";
   }
 
@@ -72,12 +72,58 @@ public:
     return data.has_txt() ? data.txt() : "empty";
   }
 
+  void populateModel(const std::string& slot_name, arcs::Dictionary* model) override {
+    const arcs::Data& data = data_.get();
+    if (data.has_num()) {
+      model->emplace("num", arcs::num_to_str(data.num()));
+    }
+  }
+
   arcs::Singleton<arcs::Data> data_;
 };
 
 DEFINE_PARTICLE(AutoRenderTest)
 
 
+class ModelWriterTest : public arcs::Particle {
+public:
+  ModelWriterTest() {
+    registerHandle("data", data_);
+    autoRender();
+  }
+
+  std::string_view getTemplateView(const std::string& slot_name) override {
+    return "model";
+  }
+
+  void writeModel(const std::string& slot_name, arcs::ModelWriter* model) override {
+    const arcs::Data& data = data_.get();
+    if (!data.has_txt()) {
+      return;
+    }
+    model->set("txt", data.txt()).set("num", data.num()).set("flg", data.flg());
+    model->beginList("chars", "char_template");
+    for (size_t i = 0; i < data.txt().size(); i++) {
+      model->beginRecord();
+      model->set("c", std::string_view(&data.txt()[i], 1)).set("i", i);
+      model->endRecord();
+    }
+    model->endList();
+    model->beginList("empty");
+    model->endList();
+  }
+
+  // Used when writeModel() doesn't write anything.
+  void populateModel(const std::string& slot_name, arcs::Dictionary* model) override {
+    model->emplace("state", "empty");
+  }
+
+  arcs::Singleton<arcs::Data> data_;
+};
+
+DEFINE_PARTICLE(ModelWriterTest)
+
+
 class EventsTest : public arcs::Particle {
 public:
   EventsTest() {
@@ -222,3 +268,168 @@ public:
 };
 
 DEFINE_PARTICLE(OutputReferenceHandlesTest)
+
+
+class BatchedWritesTest : public arcs::Particle {
+public:
+  BatchedWritesTest() {
+    registerHandle("sng", sng_);
+    registerHandle("col", col_);
+  }
+
+  static arcs::Data entity(const std::string& id, double num) {
+    arcs::Data d;
+    arcs::internal::Accessor::set_id(&d, id);
+    d.set_num(num);
+    return d;
+  }
+
+  void init() override {
+    {
+      auto sng_batch = sng_.batch();
+      auto col_batch = col_.batch();
+
+      arcs::Data x = entity("idX", 1);
+      arcs::Data y = entity("idY", 2);
+      sng_.set(&x);
+      sng_.clear();
+      sng_.set(&y);
+
+      arcs::Data a1 = entity("idA", 1);
+      arcs::Data a2 = entity("idA", 2);
+      arcs::Data b = entity("idB", 3);
+      arcs::Data c = entity("idC", 4);
+      col_.store(&c);
+      col_.clear();
+      {
+        auto nested = col_.batch();
+        col_.store(&a1);
+        col_.store(&b);
+      }
+      col_.store(&a2);
+      col_.remove(b);
+
+      // Ids for new entities are created locally, so they can be batched as well.
+      arcs::Data d;
+      d.set_txt("new");
+      col_.store(&d);
+    }
+
+    // Removals only send the id, whether batched or not.
+    arcs::Data e = entity("idE", 5);
+    col_.store(&e);
+    col_.remove("idE");
+  }
+
+  arcs::Singleton<arcs::Data> sng_;
+  arcs::Collection<arcs::Data> col_;
+};
+
+DEFINE_PARTICLE(BatchedWritesTest)
+
+
+// Run with the host failing to provide id prefixes, so new entities get their ids from the host.
+class IdLeaseFailureTest : public arcs::Particle {
+public:
+  IdLeaseFailureTest() {
+    registerHandle("sng", sng_);
+    registerHandle("col", col_);
+  }
+
+  void init() override {
+    arcs::Data a;
+    a.set_num(1);
+    col_.store(&a);
+    {
+      auto sng_batch = sng_.batch();
+      auto col_batch = col_.batch();
+
+      arcs::Data s;
+      s.set_num(4);
+      sng_.set(&s);
+
+      arcs::Data b;
+      arcs::internal::Accessor::set_id(&b, "idB");
+      b.set_num(2);
+      arcs::Data c;
+      c.set_num(3);
+      col_.store(&b);
+      col_.store(&c);
+    }
+
+    // Only works if the particle was given the id the host created for 'a'.
+    col_.remove(a);
+  }
+
+  arcs::Singleton<arcs::Data> sng_;
+  arcs::Collection<arcs::Data> col_;
+};
+
+DEFINE_PARTICLE(IdLeaseFailureTest)
+
+
+class ElidedWritesTest : public arcs::Particle {
+public:
+  ElidedWritesTest() {
+    registerHandle("sng", sng_);
+    registerHandle("col", col_);
+    sng_.elideRedundantWrites();
+    col_.elideRedundantWrites();
+  }
+
+  void init() override {
+    // Recomputed values are dropped, and take the id of the stored value.
+    arcs::Data first, second, third;
+    first.set_num(1);
+    second.set_num(1);
+    third.set_num(2);
+    sng_.set(&first);
+    sng_.set(&second);
+    sng_.set(&third);
+
+    arcs::Data d;
+    d.set_num(1);
+    col_.store(&d);
+    col_.store(&d);
+    d.set_num(2);
+    col_.store(&d);
+
+    arcs::Data count;
+    count.set_txt("elided");
+    count.set_num(sng_.elidedWrites() + col_.elidedWrites());
+    col_.store(&count);
+  }
+
+  arcs::Singleton<arcs::Data> sng_;
+  arcs::Collection<arcs::Data> col_;
+};
+
+DEFINE_PARTICLE(ElidedWritesTest)
+
+
+class SingletonPatchTest : public arcs::Particle {
+public:
+  SingletonPatchTest() {
+    registerHandle("sng", sng_);
+    registerHandle("res", res_);
+  }
+
+  // Records each value received, then marks it as seen by setting flg and clearing txt; the
+  // changes to the current entity are sent to the host as a patch.
+  void onHandleUpdate(const std::string& name) override {
+    arcs::Data copy = arcs::clone_entity(sng_.get());
+    res_.store(&copy);
+    if (!sng_.get().has_flg()) {
+      arcs::Data seen = arcs::clone_entity(sng_.get());
+      arcs::internal::Accessor::copy_id(&seen, sng_.get());
+      seen.set_flg(true);
+      seen.clear_txt();
+      sng_.set(&seen);
+    }
+  }
+
+  arcs::Singleton<arcs::Data> sng_;
+  arcs::Collection<arcs::Data> res_;
+};
+
+DEFINE_PARTICLE(SingletonPatchTest)
@@ -15,6 +15,7 @@ import {RozSlotComposer} from '../../../runtime/testing/fake-slot-composer.js';
 import {VolatileStorage, VolatileSingleton, VolatileCollection} from '../../../runtime/storage/volatile-storage.js';
 import {assertThrowsAsync} from '../../../runtime/testing/test-util.js';
 import {ReferenceType} from '../../../runtime/type.js';
+import {WasmParticle} from '../../../runtime/wasm.js';
 
 // Import some service definition files for their side-effects (the services get
 // registered automatically).
@@ -156,12 +157,54 @@ describe('wasm tests (C++)', () => {
     await data.set({id: 'i1', rawData: {txt: 'update'}});
     await arc.idle;
 
+    // Models after the first are sent as patches, which are merged with the previous model. Updates
+    // that don't change the template or model are not rendered.
+    await data.set({id: 'i2', rawData: {txt: 'update', num: 5}});
+    await arc.idle;
+    await data.set({id: 'i3', rawData: {txt: 'update', num: 5}});
+    await arc.idle;
+    await data.set({id: 'i4', rawData: {txt: 'update'}});
+    await arc.idle;
+
     // First renderSlot call is initiated by the runtime, before handles are synced.
-    // With auto-render enabled, the second call occurs after sync and the third on handle update.
+    // With auto-render enabled, the second call occurs after sync and the rest on handle updates.
     assert.deepStrictEqual(slotComposer.received, [
       ['AutoRenderTest', 'root', {template: 'empty', model: {}}],
       ['AutoRenderTest', 'root', {template: 'initial', model: {}}],
       ['AutoRenderTest', 'root', {template: 'update', model: {}}],
+      ['AutoRenderTest', 'root', {template: 'update', model: {num: '5'}}],
+      ['AutoRenderTest', 'root', {template: 'update', model: {}}],
+    ]);
+  });
+
+  it('writeModel', async () => {
+    const {arc, stores, slotComposer} = await setup(`
+      import '${schemasFile}'
+
+      particle ModelWriterTest in '${buildDir}/test-module.wasm'
+        consume root
+        in Data data
+
+      recipe
+        slot 'rootslotid-root' as slot1
+        ModelWriterTest
+          consume root as slot1
+          data <- h1
+      `);
+    const data = stores.get('data') as VolatileSingleton;
+
+    await data.set({id: 'i1', rawData: {txt: 'ab', num: 2.5, flg: true}});
+    await arc.idle;
+
+    // Falls back to populateModel() when nothing is written.
+    await data.set({id: 'i2', rawData: {num: 7}});
+    await arc.idle;
+
+    const chars = {$template: 'char_template', models: [{c: 'a', i: 0}, {c: 'b', i: 1}]};
+    assert.deepStrictEqual(slotComposer.received, [
+      ['ModelWriterTest', 'root', {template: 'model', model: {state: 'empty'}}],
+      ['ModelWriterTest', 'root', {template: 'model', model: {txt: 'ab', num: 2.5, flg: true, chars, empty: []}}],
+      ['ModelWriterTest', 'root', {template: 'model', model: {state: 'empty'}}],
     ]);
   });
 
@@ -220,6 +263,127 @@ describe('wasm tests (C++)', () => {
     assert.match(clock.payload, /^value:20[0-9]{2}-[0-9]{2}-[0-9]{2};$/);  // eg. 'value:2019-11-07;'
   });
 
+  it('batched writes', async () => {
+    const {stores} = await setup(`
+      import '${schemasFile}'
+
+      particle BatchedWritesTest in '${buildDir}/test-module.wasm'
+        out Data sng
+        out [Data] col
+
+      recipe
+        BatchedWritesTest
+          sng -> h1
+          col -> h2
+      `);
+    const sng = stores.get('sng') as VolatileSingleton;
+    const col = stores.get('col') as VolatileCollection;
+
+    const result = await sng.get();
+    assert.strictEqual(result.id, 'idY');
+    assert.deepStrictEqual(result.rawData, {num: 2});
+
+    // The batch sent a clear followed by stores, which have to reach storage in that order.
+    const entities = await col.toList();
+    assert.sameDeepMembers(entities.map(e => e.rawData), [{num: 2}, {txt: 'new'}]);
+    assert.include(entities.map(e => e.id), 'idA');
+    // Created from the id prefix given to the handle when it was connected.
+    const created = entities.find(e => e.rawData.txt === 'new');
+    assert.match(created.id, /:ids[0-9]+:0$/);
+  });
+
+  it('writes when the id lease fails', async () => {
+    const storeIdPrefix = WasmParticle.prototype['storeIdPrefix'];
+    WasmParticle.prototype['storeIdPrefix'] = () => 0;
+    let stores;
+    try {
+      ({stores} = await setup(`
+        import '${schemasFile}'
+
+        particle IdLeaseFailureTest in '${buildDir}/test-module.wasm'
+          out Data sng
+          out [Data] col
+
+        recipe
+          IdLeaseFailureTest
+            sng -> h1
+            col -> h2
+        `));
+    } finally {
+      WasmParticle.prototype['storeIdPrefix'] = storeIdPrefix;
+    }
+    const sng = stores.get('sng') as VolatileSingleton;
+    const col = stores.get('col') as VolatileCollection;
+
+    const result = await sng.get();
+    assert.isNotEmpty(result.id);
+    assert.deepStrictEqual(result.rawData, {num: 4});
+
+    const entities = await col.toList();
+    assert.sameDeepMembers(entities.map(e => e.rawData), [{num: 2}, {num: 3}]);
+    assert.include(entities.map(e => e.id), 'idB');
+    entities.forEach(e => assert.isNotEmpty(e.id));
+  });
+
+  it('redundant write elision', async () => {
+    const {stores} = await setup(`
+      import '${schemasFile}'
+
+      particle ElidedWritesTest in '${buildDir}/test-module.wasm'
+        out Data sng
+        out [Data] col
+
+      recipe
+        ElidedWritesTest
+          sng -> h1
+          col -> h2
+      `);
+    const sng = stores.get('sng') as VolatileSingleton;
+    const col = stores.get('col') as VolatileCollection;
+
+    assert.deepStrictEqual((await sng.get()).rawData, {num: 2});
+    assert.sameDeepMembers((await col.toList()).map(e => e.rawData), [
+      {num: 2},
+      {txt: 'elided', num: 2},
+    ]);
+  });
+
+  it('singleton patches', async () => {
+    const {arc, stores} = await setup(`
+      import '${schemasFile}'
+
+      particle SingletonPatchTest in '${buildDir}/test-module.wasm'
+        inout Data sng
+        out [Data] res
+
+      recipe
+        SingletonPatchTest
+          sng <-> h1
+          res -> h2
+      `);
+    const sng = stores.get('sng') as VolatileSingleton;
+    const res = stores.get('res') as VolatileCollection;
+
+    // The first value is sent in full; the particle's response is a patch.
+    await sng.set({id: 'p1', rawData: {num: 1, txt: 'a'}});
+    await arc.idle;
+    let stored = await sng.get();
+    assert.strictEqual(stored.id, 'p1');
+    assert.deepStrictEqual(stored.rawData, {num: 1, flg: true});
+
+    // Changes to the same entity are sent to the particle as a patch, including the cleared flg.
+    await sng.set({id: 'p1', rawData: {num: 2, txt: 'b', lnk: 'http://x'}});
+    await arc.idle;
+    stored = await sng.get();
+    assert.strictEqual(stored.id, 'p1');
+    assert.deepStrictEqual(stored.rawData, {num: 2, lnk: 'http://x', flg: true});
+
+    assert.deepStrictEqual((await res.toList()).map(e => e.rawData), [
+      {num: 1, txt: 'a'},
+      {num: 2, txt: 'b', lnk: 'http://x'},
+    ]);
+  });
+
   // TODO: fix PEC -> host error handling
   it.skip('missing registerHandle', async () => {
     assertThrowsAsync(async () => await setup(`
@@ -297,6 +461,50 @@ describe('wasm tests (C++)', () => {
     }
   });
 
+  prefix('collection API', async () => {
+    const {stores} = await setup(`
+      import '${schemasFile}'
+
+      particle CollectionApiTest in '${buildDir}/test-module.wasm'
+        inout [Data] col
+        out [Data] errors
+
+      recipe
+        CollectionApiTest
+          col <-> h1
+          errors -> h2
+      `);
+    const errStore = stores.get('errors') as VolatileCollection;
+    const errors = (await errStore.toList()).map(e => e.rawData.txt);
+    if (errors.length > 0) {
+      assert.fail(`${errors.length} errors found:\n${errors.join('\n')}`);
+    }
+  });
+
+  async function runKernelsTest(module: string) {
+    const {stores} = await setup(`
+      import '${schemasFile}'
+
+      particle KernelsTest in '${buildDir}/${module}'
+        inout [Data] col
+        out [Data] errors
+
+      recipe
+        KernelsTest
+          col <-> h1
+          errors -> h2
+      `);
+    const errStore = stores.get('errors') as VolatileCollection;
+    const errors = (await errStore.toList()).map(e => e.rawData.txt);
+    if (errors.length > 0) {
+      assert.fail(`${errors.length} errors found:\n${errors.join('\n')}`);
+    }
+  }
+
+  prefix('column kernels', async () => runKernelsTest('test-module.wasm'));
+
+  prefix('column kernels (SIMD)', async () => runKernelsTest('test-module-simd.wasm'));
+
   it('reading from reference-typed handles', async () => {
     const {arc, stores} = await setup(`
       import '${schemasFile}'
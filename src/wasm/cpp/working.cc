@@ -17,7 +17,7 @@ public:
     autoRender();
   }
 
-  std::string getTemplate(const std::string& slot_name) override {
+  std::string_view getTemplateView(const std::string& slot_name) override {
     return R"(
       <style>
         #panel { margin: 10px; }
@@ -175,7 +175,7 @@ external fun collectionRemove(particlePtr: WasmAddress, handlePtr: WasmAddress,
 external fun collectionClear(particlePtr: WasmAddress, handlePtr: WasmAddress)
 
 @SymbolName("_render")
-external fun render(particlePtr: WasmAddress, slotNamePtr: WasmString, templatePtr: WasmString, modelPtr: WasmString)
+external fun render(particlePtr: WasmAddress, slotNamePtr: WasmString, templateIdPtr: WasmString, modelPtr: WasmString)
 
 @SymbolName("_onRenderOutput")
 external fun onRenderOutput(particlePtr: WasmAddress, templatePtr: WasmString, modelPtr: WasmString)